@@ -2,10 +2,12 @@ extern crate proc_macro;
 
 use proc_macro2::TokenStream;
 use quote::{quote, quote_spanned};
-use syn::spanned::Spanned;
-use syn::{parse_macro_input, parse_quote, Data, DeriveInput, Fields, GenericParam, Generics};
+use syn::{
+    parse_macro_input, parse_quote, Data, DeriveInput, Error, Fields, GenericParam, Generics,
+    Ident, Lit, Meta, NestedMeta, Path, Result,
+};
 
-#[proc_macro_derive(RefData)]
+#[proc_macro_derive(RefData, attributes(blp))]
 pub fn derive_ref_data(input: proc_macro::TokenStream) -> proc_macro::TokenStream {
     let input = parse_macro_input!(input as DeriveInput);
 
@@ -15,14 +17,21 @@ pub fn derive_ref_data(input: proc_macro::TokenStream) -> proc_macro::TokenStrea
     let generics = add_trait_bounds(input.generics);
     let (impl_generics, ty_generics, where_clause) = generics.split_for_impl();
 
-    // Generate an expression to sum up the heap size of each field.
-    let fields = fields(&input.data);
-    let on_field = on_field(&input.data);
+    let blp_fields = match blp_fields(&input.data) {
+        Ok(fields) => fields,
+        Err(e) => return e.to_compile_error().into(),
+    };
+    let fields = fields(&blp_fields);
+    let on_field = on_field(&blp_fields);
+    let on_named_field = on_named_field(&blp_fields);
+    let on_value = on_value(&blp_fields);
 
     let expanded = quote! {
         impl #impl_generics blpapi::ref_data::RefData for #name #ty_generics #where_clause {
             #fields
             #on_field
+            #on_named_field
+            #on_value
         }
     };
     proc_macro::TokenStream::from(expanded)
@@ -39,50 +48,195 @@ fn add_trait_bounds(mut generics: Generics) -> Generics {
     generics
 }
 
-/// fn on_field(...) {...}
-fn on_field(data: &Data) -> TokenStream {
+/// A struct field along with its bloomberg field
+struct BlpField {
+    ident: Ident,
+    /// Bloomberg field, `#[blp(field = "...")]` or the uppercase field ident
+    field: String,
+    /// Decoder, `#[blp(decode = "path::to::fn")]` with `fn(&Element) -> Option<T>`
+    decode: Option<Path>,
+}
+
+impl BlpField {
+    /// self.#ident = ... (when there is a valid value)
+    fn assign(&self) -> TokenStream {
+        let ident = &self.ident;
+        match self.decode {
+            Some(ref decode) => quote_spanned! {ident.span()=>
+                if let Some(v) = #decode(element) {
+                    self.#ident = v;
+                }
+            },
+            None => quote_spanned! {ident.span()=>
+                if let Some(v) = element.get_at(0) {
+                    self.#ident = v;
+                }
+            },
+        }
+    }
+}
+
+fn blp_fields(data: &Data) -> Result<Vec<BlpField>> {
     match data {
         Data::Struct(ref data) => match data.fields {
-            Fields::Named(ref fields) => {
-                let recurse = fields.named.iter().map(|f| {
-                    let name = &f.ident;
-                    let field = f.ident.as_ref().unwrap().to_string().to_uppercase();
-                    quote_spanned! {f.span()=>
-                        #field => if let Some(v) = element.get_at(0) {
-                            self.#name = v;
-                        },
+            Fields::Named(ref fields) => fields.named.iter().map(blp_field).collect(),
+            ref fields => Err(Error::new_spanned(fields, "expecting named fields")),
+        },
+        Data::Enum(ref data) => Err(Error::new_spanned(data.enum_token, "expecting a struct")),
+        Data::Union(ref data) => Err(Error::new_spanned(data.union_token, "expecting a struct")),
+    }
+}
+
+fn blp_field(f: &syn::Field) -> Result<BlpField> {
+    let ident = f.ident.clone().unwrap();
+    let mut field = ident.to_string().to_uppercase();
+    let mut decode = None;
+    for attr in f.attrs.iter().filter(|a| a.path.is_ident("blp")) {
+        let list = match attr.parse_meta()? {
+            Meta::List(list) => list,
+            meta => return Err(Error::new_spanned(meta, "expecting #[blp(...)] attribute")),
+        };
+        for nested in list.nested {
+            match nested {
+                NestedMeta::Meta(Meta::NameValue(ref nv)) if nv.path.is_ident("field") => {
+                    match nv.lit {
+                        Lit::Str(ref s) => field = s.value(),
+                        ref lit => {
+                            return Err(Error::new_spanned(
+                                lit,
+                                "expecting #[blp(field = \"...\")]",
+                            ))
+                        }
                     }
-                });
-                quote! {
-                    fn on_field(&mut self, field: &str, element: &blpapi::element::Element) {
-                        match field {
-                            #(#recurse)*
-                            _ => { dbg!("Unrecognized field '{}'", field); }
+                }
+                NestedMeta::Meta(Meta::NameValue(ref nv)) if nv.path.is_ident("decode") => {
+                    match nv.lit {
+                        Lit::Str(ref s) => decode = Some(s.parse()?),
+                        ref lit => {
+                            return Err(Error::new_spanned(
+                                lit,
+                                "expecting #[blp(decode = \"...\")]",
+                            ))
                         }
                     }
                 }
+                nested => {
+                    return Err(Error::new_spanned(
+                        nested,
+                        "unknown blp attribute, expecting 'field' or 'decode'",
+                    ))
+                }
             }
-            _ => unimplemented!(),
-        },
-        Data::Enum(_) | Data::Union(_) => unimplemented!(),
+        }
     }
+    Ok(BlpField {
+        ident,
+        field,
+        decode,
+    })
 }
 
-/// const FIELDS = ...
-fn fields(data: &Data) -> TokenStream {
-    match data {
-        Data::Struct(ref data) => match data.fields {
-            Fields::Named(ref fields) => {
-                let recurse = fields.named.iter().map(|f| {
-                    let field = f.ident.as_ref().unwrap().to_string().to_uppercase();
-                    quote_spanned! {f.span()=> #field }
-                });
-                quote! {
-                    const FIELDS: &'static [&'static str] = &[#(#recurse),*];
-                }
+/// fn on_field(...) {...}
+fn on_field(fields: &[BlpField]) -> TokenStream {
+    let recurse = fields.iter().map(|f| {
+        let field = &f.field;
+        let assign = f.assign();
+        quote_spanned! {f.ident.span()=>
+            #field => { #assign }
+        }
+    });
+    quote! {
+        fn on_field(&mut self, field: &str, element: &blpapi::element::Element) {
+            match field {
+                #(#recurse)*
+                _ => blpapi::ref_data::unknown_field(field),
             }
-            _ => unimplemented!(),
-        },
-        Data::Enum(_) | Data::Union(_) => unimplemented!(),
+        }
+    }
+}
+
+/// fn on_named_field(...) {...}
+///
+/// Dispatches on the index of the field `Name` in a static table of interned names
+fn on_named_field(fields: &[BlpField]) -> TokenStream {
+    let names = fields.iter().map(|f| &f.field);
+    let recurse = fields.iter().enumerate().map(|(i, f)| {
+        let assign = f.assign();
+        quote_spanned! {f.ident.span()=>
+            Some(#i) => { #assign }
+        }
+    });
+    quote! {
+        fn on_named_field(&mut self, field: &blpapi::name::Name, element: &blpapi::element::Element) {
+            blpapi::lazy_static::lazy_static! {
+                static ref FIELD_INDEX: blpapi::ref_data::FieldIndex =
+                    blpapi::ref_data::FieldIndex::new(&[#(#names),*]);
+            }
+            match FIELD_INDEX.get(field) {
+                #(#recurse)*
+                _ => blpapi::ref_data::unknown_field(field),
+            }
+        }
     }
 }
+
+/// fn on_value(...) -> bool {...}
+///
+/// Fields with a custom decoder need an `Element` and are not supported, as
+/// well as fields which don't implement `FromValue` (resolved by autoref, see
+/// `blpapi::value::Slot`)
+fn on_value(fields: &[BlpField]) -> TokenStream {
+    let recurse = fields.iter().map(|f| {
+        let field = &f.field;
+        let ident = &f.ident;
+        match f.decode {
+            Some(_) => quote_spanned! {ident.span()=>
+                #field => false,
+            },
+            None => quote_spanned! {ident.span()=>
+                #field => (&&blpapi::value::Slot::new(&mut self.#ident)).set_value(value),
+            },
+        }
+    });
+    quote! {
+        fn on_value(&mut self, field: &str, value: &blpapi::value::Value) -> bool {
+            #[allow(unused_imports)]
+            use blpapi::value::{SetFromValue as _, SetNoValue as _};
+            match field {
+                #(#recurse)*
+                _ => false,
+            }
+        }
+    }
+}
+
+/// const FIELDS = ...
+fn fields(fields: &[BlpField]) -> TokenStream {
+    let recurse = fields.iter().map(|f| {
+        let field = &f.field;
+        quote_spanned! {f.ident.span()=> #field }
+    });
+    quote! {
+        const FIELDS: &'static [&'static str] = &[#(#recurse),*];
+    }
+}
+
+#[test]
+fn invalid_attributes() {
+    let error = |input: &str| {
+        let input: DeriveInput = syn::parse_str(input).unwrap();
+        blp_fields(&input.data).err().map(|e| e.to_string())
+    };
+    assert!(error("struct A { #[blp(field = \"PX_LAST\")] a: f64 }").is_none());
+    assert_eq!(
+        error("struct A { #[blp(field = 1)] a: f64 }").unwrap(),
+        "expecting #[blp(field = \"...\")]"
+    );
+    assert_eq!(
+        error("struct A { #[blp(name = \"PX_LAST\")] a: f64 }").unwrap(),
+        "unknown blp attribute, expecting 'field' or 'decode'"
+    );
+    assert!(error("struct A { #[blp(decode = \"not a path\")] a: f64 }").is_some());
+    assert_eq!(error("struct A(f64);").unwrap(), "expecting named fields");
+    assert_eq!(error("enum A { B }").unwrap(), "expecting a struct");
+}
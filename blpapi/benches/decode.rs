@@ -0,0 +1,414 @@
+//! Decoding benchmarks
+//!
+//! Field dispatch benchmarks run offline. Response decoding benchmarks
+//! record a few responses from a terminal once, then replay and decode them
+//! again and again, without any network round trip.
+//!
+//! Recordings are saved under `target/recordings` and decoded offline on
+//! later runs, even without a terminal, by the same decoders as live
+//! responses. Without any saved recording, offline benchmarks run on
+//! synthetic responses of the same shape.
+//!
+//! Results are checked against a baseline saved with `BLPAPI_BENCH_SAVE=1`:
+//! the run fails if a benchmark is slower than `BLPAPI_BENCH_TOLERANCE`
+//! (defaults to 0.2, i.e. 20%) or allocates more.
+//!
+//! ```sh
+//! BLPAPI_BENCH_SAVE=1 cargo bench --features derive
+//! cargo bench --features derive
+//! ```
+
+use blpapi::{
+    datetime::Datetime,
+    element::Element,
+    name::{self, Name},
+    ref_data::FieldIndex,
+    replay::{Node, Recording, Replay},
+    session::{HistOptions, SessionSync},
+    value::Value,
+    Error, RefData,
+};
+use std::alloc::{GlobalAlloc, Layout, System};
+use std::collections::HashMap;
+use std::path::PathBuf;
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::Mutex;
+use std::time::{Duration, Instant};
+
+/// An allocator counting allocations
+struct Counting;
+
+static ALLOCATIONS: AtomicUsize = AtomicUsize::new(0);
+
+unsafe impl GlobalAlloc for Counting {
+    unsafe fn alloc(&self, layout: Layout) -> *mut u8 {
+        ALLOCATIONS.fetch_add(1, Ordering::Relaxed);
+        System.alloc(layout)
+    }
+    unsafe fn dealloc(&self, ptr: *mut u8, layout: Layout) {
+        System.dealloc(ptr, layout)
+    }
+}
+
+#[global_allocator]
+static GLOBAL: Counting = Counting;
+
+const BENCH_DURATION: Duration = Duration::from_secs(2);
+
+lazy_static::lazy_static! {
+    /// (name, us/iter, allocs/item) of each benchmark run
+    static ref RESULTS: Mutex<Vec<(String, f64, f64)>> = Mutex::new(Vec::new());
+}
+
+/// Run `f` for about `BENCH_DURATION` and print its timings
+///
+/// `f` returns the number of items (fields, values ...) processed per iteration
+fn bench<F: FnMut() -> usize>(name: &str, mut f: F) {
+    f();
+    let allocations = ALLOCATIONS.load(Ordering::Relaxed);
+    let start = Instant::now();
+    let (mut iterations, mut items) = (0u64, 0usize);
+    while start.elapsed() < BENCH_DURATION {
+        items += f();
+        iterations += 1;
+    }
+    let elapsed = start.elapsed().as_secs_f64();
+    let allocations = ALLOCATIONS.load(Ordering::Relaxed) - allocations;
+    let (us_per_iter, allocs_per_item) = (
+        elapsed * 1e6 / iterations as f64,
+        allocations as f64 / items.max(1) as f64,
+    );
+    println!(
+        "{:<32} {:>12.3} us/iter {:>14.0} items/s {:>8.3} allocs/item",
+        name,
+        us_per_iter,
+        items as f64 / elapsed,
+        allocs_per_item,
+    );
+    let result = (name.to_owned(), us_per_iter, allocs_per_item);
+    RESULTS.lock().unwrap().push(result);
+}
+
+/// Compare the results to the saved baseline, or save them as the new baseline
+///
+/// Returns the regressions
+fn check_baseline() -> Vec<String> {
+    let path = recording_path("baseline").with_extension("txt");
+    let results = RESULTS.lock().unwrap();
+    if std::env::var_os("BLPAPI_BENCH_SAVE").is_some() {
+        let lines = results
+            .iter()
+            .map(|(name, us, allocs)| format!("{} {} {}\n", name, us, allocs))
+            .collect::<String>();
+        if let Err(e) = std::fs::write(&path, lines) {
+            println!("cannot save baseline {}: {}", path.display(), e);
+        }
+        return Vec::new();
+    }
+    let baseline = match std::fs::read_to_string(&path) {
+        Ok(baseline) => baseline,
+        Err(_) => {
+            println!("no baseline, save one with BLPAPI_BENCH_SAVE=1");
+            return Vec::new();
+        }
+    };
+    let baseline = baseline
+        .lines()
+        .filter_map(|line| {
+            let mut parts = line.split(' ');
+            let name = parts.next()?;
+            let us = parts.next()?.parse::<f64>().ok()?;
+            let allocs = parts.next()?.parse::<f64>().ok()?;
+            Some((name, (us, allocs)))
+        })
+        .collect::<HashMap<_, _>>();
+    let tolerance = std::env::var("BLPAPI_BENCH_TOLERANCE")
+        .ok()
+        .and_then(|t| t.parse::<f64>().ok())
+        .unwrap_or(0.2);
+    let mut regressions = Vec::new();
+    for (name, us, allocs) in results.iter() {
+        if let Some((base_us, base_allocs)) = baseline.get(&**name) {
+            if *us > base_us * (1. + tolerance) {
+                regressions.push(format!("{}: {:.3} us/iter, was {:.3}", name, us, base_us));
+            }
+            if *allocs > base_allocs + 0.001 {
+                let regression = format!(
+                    "{}: {:.3} allocs/item, was {:.3}",
+                    name, allocs, base_allocs
+                );
+                regressions.push(regression);
+            }
+        }
+    }
+    regressions
+}
+
+#[derive(Debug, Default, RefData)]
+struct Equity {
+    ticker: String,
+    crncy: String,
+    name: String,
+    px_last: f64,
+    cur_mkt_cap: f64,
+    eqy_sh_out: f64,
+    id_isin: Option<String>,
+}
+
+#[derive(Debug, Default, RefData)]
+struct Price {
+    px_open: f64,
+    px_high: f64,
+    px_low: f64,
+    px_last: f64,
+    px_volume: f64,
+}
+
+/// Compare the string based dispatch to the interned `Name` one
+fn field_dispatch() {
+    let names = Equity::FIELDS
+        .iter()
+        .map(|f| Name::new(f))
+        .collect::<Vec<_>>();
+
+    bench("dispatch/string_name", || {
+        for name in &names {
+            let field = name.to_string_lossy().into_owned();
+            let _ = Equity::FIELDS.iter().position(|f| *f == field);
+        }
+        names.len()
+    });
+
+    let index = FieldIndex::new(Equity::FIELDS);
+    bench("dispatch/field_index", || {
+        for name in &names {
+            let _ = index.get(name);
+        }
+        names.len()
+    });
+}
+
+const SECURITIES: &[&str] = &[
+    "IBM US Equity",
+    "MSFT US Equity",
+    "AAPL US Equity",
+    "VOD LN Equity",
+    "7203 JT Equity",
+];
+
+/// Path of a saved recording
+fn recording_path(name: &str) -> PathBuf {
+    let dir = PathBuf::from(env!("CARGO_MANIFEST_DIR")).join("../target/recordings");
+    let _ = std::fs::create_dir_all(&dir);
+    dir.join(format!("{}.rec", name))
+}
+
+/// Record reference and historical data responses from a terminal
+fn record() -> Result<(Replay, Replay), Error> {
+    let mut session = SessionSync::new()?;
+    let securities = SECURITIES;
+
+    session.start_recording();
+    session.ref_data::<_, Equity>(securities)?;
+    let ref_data = session.stop_recording();
+
+    session.start_recording();
+    let options = HistOptions::new("20100101", "20191231");
+    session.hist_data::<_, Price>(securities, options)?;
+    let hist_data = session.stop_recording();
+
+    Ok((ref_data, hist_data))
+}
+
+/// Synthetic responses, 10 years of daily prices per security
+fn synthetic() -> (Recording, Recording) {
+    let string = |s: &str| Node::Value(Value::String(s.into()));
+    let float = |f: f64| Node::Value(Value::Float(f));
+    let security = |ticker: &str, fields: Node| {
+        Node::sequence(vec![("security", string(ticker)), ("fieldData", fields)])
+    };
+
+    let securities = SECURITIES
+        .iter()
+        .map(|ticker| {
+            let mut fields = vec![
+                ("TICKER", string(ticker)),
+                ("CRNCY", string("USD")),
+                ("NAME", string(ticker)),
+                ("ID_ISIN", string("US0000000000")),
+            ];
+            for field in &["PX_LAST", "CUR_MKT_CAP", "EQY_SH_OUT"] {
+                fields.push((field, float(100.)));
+            }
+            security(ticker, Node::sequence(fields))
+        })
+        .collect();
+    let mut ref_data = Recording::new();
+    ref_data.push(
+        "ReferenceDataResponse",
+        Node::sequence(vec![("securityData", Node::Array(securities))]),
+    );
+
+    let mut hist_data = Recording::new();
+    for ticker in SECURITIES {
+        let points = (14_610..14_610 + 3_650)
+            .filter(|day| (day + 4) % 7 < 5)
+            .map(|day| {
+                let date = Datetime::from_days_since_epoch(day);
+                let mut point = vec![("date", Node::Value(Value::Datetime(date)))];
+                for field in Price::FIELDS {
+                    point.push((field, float(day as f64)));
+                }
+                Node::sequence(point)
+            })
+            .collect();
+        let security = security(ticker, Node::Array(points));
+        hist_data.push(
+            "HistoricalDataResponse",
+            Node::sequence(vec![("securityData", security)]),
+        );
+    }
+    (ref_data, hist_data)
+}
+
+/// Saved recordings, or synthetic ones
+fn recordings() -> (Recording, Recording) {
+    let saved = Recording::load(recording_path("ref_data"))
+        .and_then(|r| Ok((r, Recording::load(recording_path("hist_data"))?)));
+    match saved {
+        Ok(recordings) => recordings,
+        Err(e) => {
+            println!("no saved recording ({}), using synthetic responses", e);
+            synthetic()
+        }
+    }
+}
+
+/// Decode recordings offline, through the same decoders as live responses
+fn decode_offline(ref_data: Recording, hist_data: Recording) {
+    let num_fields = Equity::FIELDS.len() * ref_data.ref_data::<Equity>().unwrap().len();
+    bench("recording/ref_data", || {
+        ref_data.ref_data::<Equity>().unwrap();
+        num_fields
+    });
+
+    let num_fields = Price::FIELDS.len()
+        * hist_data
+            .hist_data::<Price>()
+            .unwrap()
+            .values()
+            .map(|t| t.values.len())
+            .sum::<usize>();
+    bench("recording/hist_data", || {
+        hist_data.hist_data::<Price>().unwrap();
+        num_fields
+    });
+
+    let path = std::env::temp_dir().join(format!("blpapi-bench-{}.rec", std::process::id()));
+    hist_data.save(&path).unwrap();
+    bench("recording/load", || {
+        Recording::load(&path).unwrap();
+        num_fields
+    });
+    let _ = std::fs::remove_file(&path);
+}
+
+/// Visit all the `fieldData` values of historical data responses
+fn visit_points<F: FnMut(&Element)>(replay: &Replay, mut f: F) {
+    for event in replay.events() {
+        for message in event.messages() {
+            let security = message.element().get_named_element(&name::SECURITY_DATA);
+            if let Some(points) = security.and_then(|s| s.get_named_element(&name::FIELD_DATA)) {
+                f(&points);
+            }
+        }
+    }
+}
+
+fn decode(mut ref_data: Replay, mut hist_data: Replay) {
+    let num_fields = Equity::FIELDS.len() * ref_data.ref_data::<Equity>().unwrap().len();
+    bench("ref_data", || {
+        ref_data.rewind();
+        ref_data.ref_data::<Equity>().unwrap();
+        num_fields
+    });
+
+    let num_fields = Price::FIELDS.len()
+        * hist_data
+            .hist_data::<Price>()
+            .unwrap()
+            .values()
+            .map(|t| t.values.len())
+            .sum::<usize>();
+    bench("hist_data", || {
+        hist_data.rewind();
+        hist_data.hist_data::<Price>().unwrap();
+        num_fields
+    });
+    bench("hist_data_columnar", || {
+        hist_data.rewind();
+        hist_data.hist_data_columnar(Price::FIELDS).unwrap();
+        num_fields
+    });
+
+    bench("element/values", || {
+        let mut count = 0;
+        visit_points(&hist_data, |points| {
+            count += points.values::<Element>().count()
+        });
+        count
+    });
+
+    let px_last = Name::new("PX_LAST");
+    bench("element/get_named_element", || {
+        let mut count = 0;
+        visit_points(&hist_data, |points| {
+            for point in points.values::<Element>() {
+                count += point.get_named_element(&px_last).is_some() as usize;
+            }
+        });
+        count
+    });
+
+    let mut price = Price::default();
+    bench("derive/on_named_field", || {
+        let mut count = 0;
+        visit_points(&hist_data, |points| {
+            for point in points.values::<Element>() {
+                for field in point.elements() {
+                    price.on_named_field(&field.name(), &field);
+                    count += 1;
+                }
+            }
+        });
+        count
+    });
+}
+
+fn main() {
+    field_dispatch();
+    match record() {
+        Ok((ref_data, hist_data)) => {
+            for (name, replay) in &[("ref_data", &ref_data), ("hist_data", &hist_data)] {
+                if let Err(e) = replay.to_recording().save(recording_path(name)) {
+                    println!("cannot save {} recording: {}", name, e);
+                }
+            }
+            decode(ref_data, hist_data)
+        }
+        Err(e) => println!(
+            "skipping live decoding benchmarks, cannot record responses: {}",
+            e
+        ),
+    }
+    let (ref_data, hist_data) = recordings();
+    decode_offline(ref_data, hist_data);
+
+    let regressions = check_baseline();
+    if !regressions.is_empty() {
+        for regression in &regressions {
+            println!("regression: {}", regression);
+        }
+        std::process::exit(1);
+    }
+}
@@ -0,0 +1,870 @@
+//! Persistent reference and historical data cache
+//!
+//! A `Cache` sits in front of `SessionSync::ref_data` and `SessionSync::hist_data`.
+//! It only requests the (security, field) cells which are missing or older
+//! than their time-to-live and, for historical data, only the dates missing
+//! around the range already stored. Cached and fetched values are merged back
+//! into the same `RefData`/`TimeSerie` types.
+//!
+//! Values are stored in an append-only file, loaded in memory when opened.
+//! Use `compact` from time to time to drop the overwritten records.
+
+use crate::{
+    datetime::Datetime,
+    element::Element,
+    event::Event,
+    name,
+    ref_data::{FieldIndex, RefData},
+    session::{self, HistOptions, SessionSync, TimeSerie},
+    value::{encode_str, encode_value, Reader, Value},
+    Error,
+};
+use std::collections::{BTreeMap, HashMap, HashSet};
+use std::fs::{self, File, OpenOptions};
+use std::io::{BufWriter, Read, Write};
+use std::path::{Path, PathBuf};
+use std::time::{Duration, SystemTime, UNIX_EPOCH};
+
+/// File header, with format version
+const MAGIC: &[u8] = b"BLPCACHE1\n";
+
+/// Default time-to-live of reference data values
+const DEFAULT_TTL: Duration = Duration::from_secs(24 * 60 * 60);
+
+const SECONDS_PER_DAY: u64 = 24 * 60 * 60;
+
+/// Record tags
+const CELL: u8 = 1;
+const RANGE: u8 = 2;
+const POINT: u8 = 3;
+const CLEAR: u8 = 4;
+
+/// A cached reference data value
+struct Cell {
+    /// Fetch time, seconds since unix epoch
+    fetched: u64,
+    value: Value,
+}
+
+/// Cached historical values of a (security, field, options)
+struct Serie {
+    /// Dates fully covered (days since 1970-01-01), empty if start > end
+    coverage: (i32, i32),
+    points: BTreeMap<i32, Value>,
+}
+
+impl Default for Serie {
+    fn default() -> Self {
+        Serie {
+            coverage: (0, -1),
+            points: BTreeMap::new(),
+        }
+    }
+}
+
+impl Serie {
+    /// Coverage once `fetched` dates are stored, up to `last_complete` day
+    fn extended(&self, fetched: (i32, i32), last_complete: i32) -> (i32, i32) {
+        let (start, end) = (fetched.0, fetched.1.min(last_complete));
+        let (cov_start, cov_end) = self.coverage;
+        if start > end {
+            self.coverage
+        } else if cov_start <= cov_end && start <= cov_end + 1 && cov_start <= end + 1 {
+            (start.min(cov_start), end.max(cov_end))
+        } else {
+            (start, end)
+        }
+    }
+
+    /// Fetched `fetched` dates, now covering `coverage`
+    ///
+    /// Points of both ranges are kept, e.g. the current day which is fetched
+    /// but not covered.
+    fn apply_range(&mut self, fetched: (i32, i32), coverage: (i32, i32)) {
+        let within = |d: i32, range: (i32, i32)| range.0 <= d && d <= range.1;
+        self.points
+            .retain(|d, _| within(*d, fetched) || within(*d, coverage));
+        self.coverage = coverage;
+    }
+
+    /// Drop the points of `dates`, about to be fetched again
+    fn clear(&mut self, dates: (i32, i32)) {
+        self.points.retain(|d, _| *d < dates.0 || *d > dates.1);
+    }
+}
+
+/// (security, field, options) key of a historical serie
+type SerieKey = (String, String, String);
+
+/// A persistent cache of reference and historical data
+///
+/// # Example
+///
+/// ```
+/// # #[cfg(feature = "derive")]
+/// # {
+/// use blpapi::{RefData, cache::Cache, session::SessionSync};
+/// use std::time::Duration;
+///
+/// #[derive(Default, RefData)]
+/// struct EquityData {
+///     ticker: String,
+///     crncy: String,
+///     px_last: f64,
+/// }
+///
+/// let mut session = SessionSync::new().unwrap();
+/// let mut cache = Cache::open("refdata.cache")
+///     .unwrap()
+///     .with_ttl("PX_LAST", Duration::from_secs(60));
+/// let securities: &[&str] = &[ /* list of security tickers */ ];
+///
+/// let equities = cache.ref_data::<_, EquityData>(&mut session, securities);
+/// # }
+/// ```
+pub struct Cache {
+    path: PathBuf,
+    writer: BufWriter<File>,
+    cells: HashMap<(String, String), Cell>,
+    series: HashMap<SerieKey, Serie>,
+    default_ttl: Duration,
+    ttls: HashMap<String, Duration>,
+}
+
+impl Cache {
+    /// Open or create a cache file
+    pub fn open<P: AsRef<Path>>(path: P) -> Result<Self, Error> {
+        let path = path.as_ref().to_path_buf();
+        let mut file = OpenOptions::new()
+            .read(true)
+            .append(true)
+            .create(true)
+            .open(&path)?;
+        let mut bytes = Vec::new();
+        file.read_to_end(&mut bytes)?;
+        if bytes.is_empty() {
+            file.write_all(MAGIC)?;
+        } else if !bytes.starts_with(MAGIC) {
+            return Err(Error::NotFound(format!(
+                "cache header in {}",
+                path.display()
+            )));
+        }
+
+        let mut cache = Cache {
+            path,
+            writer: BufWriter::new(file),
+            cells: HashMap::new(),
+            series: HashMap::new(),
+            default_ttl: DEFAULT_TTL,
+            ttls: HashMap::new(),
+        };
+        if !bytes.is_empty() {
+            let len = cache.load(&bytes[MAGIC.len()..]) + MAGIC.len();
+            if len < bytes.len() {
+                // drop last record, partially written
+                log::warn!("truncating cache {} at {}", cache.path.display(), len);
+                cache.writer.get_ref().set_len(len as u64)?;
+            }
+        }
+        Ok(cache)
+    }
+
+    /// Set the time-to-live of reference data values (defaults to 1 day)
+    pub fn with_default_ttl(mut self, ttl: Duration) -> Self {
+        self.default_ttl = ttl;
+        self
+    }
+
+    /// Set the time-to-live of reference data values of a field
+    pub fn with_ttl(mut self, field: &str, ttl: Duration) -> Self {
+        self.ttls.insert(field.to_owned(), ttl);
+        self
+    }
+
+    /// Get reference data for `RefData` items
+    ///
+    /// Only the missing or stale values are requested.
+    /// Fields with a custom `decode` are always requested.
+    pub fn ref_data<I, R>(
+        &mut self,
+        session: &mut SessionSync,
+        securities: I,
+    ) -> Result<HashMap<String, R>, Error>
+    where
+        I: IntoIterator,
+        I::Item: AsRef<str>,
+        R: RefData,
+    {
+        let now = now();
+        let cacheable = cacheable::<R>();
+        let mut ref_data: HashMap<String, R> = HashMap::new();
+        let missing = self.missing_fields(securities, &cacheable, now, &mut ref_data);
+
+        // request them
+        let mut result = Ok(());
+        for (fields, securities) in missing {
+            let index = FieldIndex::new(&fields);
+            let cacheable = fields
+                .iter()
+                .map(|f| {
+                    R::FIELDS
+                        .iter()
+                        .position(|g| g == f)
+                        .map_or(false, |i| cacheable[i])
+                })
+                .collect::<Vec<_>>();
+            let mut errors = Vec::new();
+            result = session.request_events(
+                "ReferenceDataRequest",
+                &securities,
+                &fields,
+                None,
+                |event| {
+                    self.ref_data_event(
+                        event,
+                        &index,
+                        &cacheable,
+                        now,
+                        &mut ref_data,
+                        &mut errors,
+                    )?;
+                    errors.drain(..).next().map_or(Ok(()), Err)
+                },
+            );
+            if result.is_err() {
+                break;
+            }
+        }
+        self.writer.flush()?;
+        result.map(|_| ref_data)
+    }
+
+    /// Get historical data
+    ///
+    /// Only the dates missing around the range already stored are requested,
+    /// the current day is always requested again.
+    /// Requests with `max_points` or `RefData` with custom `decode`s are not cached.
+    pub fn hist_data<I, R>(
+        &mut self,
+        session: &mut SessionSync,
+        securities: I,
+        options: HistOptions,
+    ) -> Result<HashMap<String, TimeSerie<R>>, Error>
+    where
+        I: IntoIterator,
+        I::Item: AsRef<str>,
+        R: RefData,
+    {
+        let (key, (start, end)) = match (options.values_key(), options.days()) {
+            (Some(key), Some(days)) if cacheable::<R>().iter().all(|c| *c) => (key, days),
+            _ => return session.hist_data(securities, options),
+        };
+        let securities: Vec<String> = securities
+            .into_iter()
+            .map(|s| s.as_ref().to_owned())
+            .collect();
+
+        let missing = self.missing_dates(&securities, R::FIELDS, &key, (start, end));
+
+        // request them
+        let last_complete = (now() / SECONDS_PER_DAY) as i32 - 1;
+        let mut result = Ok(());
+        for (gap, securities) in missing {
+            let gap_options = options.between(gap.0, gap.1);
+            let mut points = Vec::new();
+            let mut received = HashSet::new();
+            result = session.request_events(
+                "HistoricalDataRequest",
+                &securities,
+                R::FIELDS,
+                Some(&gap_options),
+                |event| {
+                    hist_data_event(event, &mut points, &mut received);
+                    Ok(())
+                },
+            );
+            if result.is_err() {
+                break;
+            }
+            // coverage is written last: if the file is cut before, the dates
+            // are requested again
+            let mut keys = Vec::with_capacity(received.len() * R::FIELDS.len());
+            for security in &received {
+                for field in R::FIELDS {
+                    keys.push((security.clone(), field.to_string(), key.clone()));
+                }
+            }
+            for key in &keys {
+                self.put_clear(key.clone(), gap)?;
+            }
+            for (security, field, date, value) in points {
+                if received.contains(&security) {
+                    self.put_point((security, field, key.clone()), date, value)?;
+                }
+            }
+            for key in keys {
+                self.put_range(key, gap, last_complete)?;
+            }
+            self.writer.flush()?;
+        }
+        result?;
+
+        // merge into time series
+        let mut hist_data = HashMap::new();
+        for security in securities {
+            let series = R::FIELDS
+                .iter()
+                .filter_map(|field| {
+                    let key = (security.clone(), field.to_string(), key.clone());
+                    Some((*field, self.series.get(&key)?))
+                })
+                .collect::<Vec<_>>();
+            let mut rows: BTreeMap<i32, R> = BTreeMap::new();
+            for (field, serie) in &series {
+                for (date, value) in serie.points.range(start..=end) {
+                    rows.entry(*date).or_default().on_value(field, value);
+                }
+            }
+            if rows.is_empty() {
+                continue;
+            }
+            let mut serie = TimeSerie::with_capacity(rows.len());
+            for (date, value) in rows {
+                if let Some(date) = session::date_from_days(date) {
+                    serie.dates.push(date);
+                    serie.values.push(value);
+                }
+            }
+            hist_data.insert(security, serie);
+        }
+        Ok(hist_data)
+    }
+
+    /// Rewrite the cache file with only the current values
+    pub fn compact(&mut self) -> Result<(), Error> {
+        let path = self.path.with_extension("compact");
+        let mut writer = BufWriter::new(File::create(&path)?);
+        writer.write_all(MAGIC)?;
+        let mut buf = Vec::new();
+        for ((security, field), cell) in &self.cells {
+            encode_cell(&mut buf, security, field, cell.fetched, &cell.value);
+        }
+        for (key, serie) in &self.series {
+            encode_range(&mut buf, key, serie.coverage, serie.coverage);
+            for (date, value) in &serie.points {
+                encode_point(&mut buf, key, *date, value);
+            }
+            writer.write_all(&buf)?;
+            buf.clear();
+        }
+        writer.write_all(&buf)?;
+        writer.flush()?;
+        drop(writer);
+        fs::rename(&path, &self.path)?;
+        let file = OpenOptions::new().append(true).open(&self.path)?;
+        self.writer = BufWriter::new(file);
+        Ok(())
+    }
+
+    /// Cached value of a cell, if younger than its time-to-live at `now`
+    fn fresh(&self, security: &str, field: &str, now: u64) -> Option<&Value> {
+        let ttl = self.ttls.get(field).unwrap_or(&self.default_ttl);
+        self.cells
+            .get(&(security.to_owned(), field.to_owned()))
+            .filter(|cell| now.saturating_sub(cell.fetched) < ttl.as_secs())
+            .map(|cell| &cell.value)
+    }
+
+    /// Set fresh cached values into `ref_data`, group securities by missing fields
+    fn missing_fields<I, R>(
+        &self,
+        securities: I,
+        cacheable: &[bool],
+        now: u64,
+        ref_data: &mut HashMap<String, R>,
+    ) -> HashMap<Vec<&'static str>, Vec<String>>
+    where
+        I: IntoIterator,
+        I::Item: AsRef<str>,
+        R: RefData,
+    {
+        let mut missing: HashMap<Vec<&'static str>, Vec<String>> = HashMap::new();
+        for security in securities {
+            let security = security.as_ref();
+            let entry = ref_data.entry(security.to_owned()).or_default();
+            let fields = R::FIELDS
+                .iter()
+                .zip(cacheable)
+                .filter(|(field, cacheable)| {
+                    let is_hit = **cacheable
+                        && self.fresh(security, field, now).map_or(false, |value| {
+                            value.is_null() || entry.on_value(field, value)
+                        });
+                    !is_hit
+                })
+                .map(|(field, _)| *field)
+                .collect::<Vec<_>>();
+            if !fields.is_empty() {
+                missing.entry(fields).or_default().push(security.to_owned());
+            }
+        }
+        missing
+    }
+
+    /// Group securities by the `days` missing from their `fields` series
+    fn missing_dates(
+        &self,
+        securities: &[String],
+        fields: &[&str],
+        key: &str,
+        days: (i32, i32),
+    ) -> HashMap<(i32, i32), Vec<String>> {
+        let (start, end) = days;
+        let mut missing: HashMap<(i32, i32), Vec<String>> = HashMap::new();
+        for security in securities {
+            let coverage = fields
+                .iter()
+                .map(|field| {
+                    let key = (security.clone(), field.to_string(), key.to_owned());
+                    self.series.get(&key).map_or((0, -1), |s| s.coverage)
+                })
+                .fold((start, end), |(s, e), (cs, ce)| (s.max(cs), e.min(ce)));
+            let gaps = if coverage.0 > coverage.1 {
+                vec![(start, end)]
+            } else {
+                let mut gaps = Vec::with_capacity(2);
+                if start < coverage.0 {
+                    gaps.push((start, coverage.0 - 1));
+                }
+                if coverage.1 < end {
+                    gaps.push((coverage.1 + 1, end));
+                }
+                gaps
+            };
+            for gap in gaps {
+                missing.entry(gap).or_default().push(security.clone());
+            }
+        }
+        missing
+    }
+
+    /// Decode a `ReferenceDataRequest` response event of `index` fields,
+    /// storing the `cacheable` ones into the cache
+    fn ref_data_event<R: RefData>(
+        &mut self,
+        event: &Event,
+        index: &FieldIndex,
+        cacheable: &[bool],
+        now: u64,
+        ref_data: &mut HashMap<String, R>,
+        errors: &mut Vec<Error>,
+    ) -> Result<(), Error> {
+        for message in event.messages().map(|m| m.element()) {
+            let securities = match message.get_named_element(&name::SECURITY_DATA) {
+                Some(securities) => securities,
+                None => continue,
+            };
+            for security in securities.values::<Element>() {
+                let ticker = security
+                    .get_named_element(&name::SECURITY_NAME)
+                    .and_then(|s| s.get_at(0))
+                    .unwrap_or_else(String::new);
+                if let Some(error) = security.get_named_element(&name::SECURITY_ERROR) {
+                    errors.push(Error::security(ticker, error));
+                    continue;
+                }
+                let fields = match security.get_named_element(&name::FIELD_DATA) {
+                    Some(fields) => fields,
+                    None => continue,
+                };
+                let entry = ref_data.entry(ticker.clone()).or_default();
+                for (name, cacheable) in index.names().iter().zip(cacheable) {
+                    let value = if fields.has_named_element(name) {
+                        let field = fields.get_named_element(name).unwrap();
+                        entry.on_named_field(name, &field);
+                        Value::from_element(&field)
+                    } else {
+                        Some(Value::Null)
+                    };
+                    if let (true, Some(value)) = (*cacheable, value) {
+                        let field = name.to_string_lossy().into_owned();
+                        self.put_cell(ticker.clone(), field, now, value)?;
+                    }
+                }
+            }
+        }
+        Ok(())
+    }
+
+    fn put_cell(
+        &mut self,
+        security: String,
+        field: String,
+        fetched: u64,
+        value: Value,
+    ) -> Result<(), Error> {
+        let mut buf = Vec::new();
+        encode_cell(&mut buf, &security, &field, fetched, &value);
+        self.writer.write_all(&buf)?;
+        self.cells
+            .insert((security, field), Cell { fetched, value });
+        Ok(())
+    }
+
+    fn put_range(
+        &mut self,
+        key: SerieKey,
+        fetched: (i32, i32),
+        last_complete: i32,
+    ) -> Result<(), Error> {
+        let mut buf = Vec::new();
+        let serie = self.series.entry(key.clone()).or_default();
+        let coverage = serie.extended(fetched, last_complete);
+        serie.apply_range(fetched, coverage);
+        encode_range(&mut buf, &key, fetched, coverage);
+        Ok(self.writer.write_all(&buf)?)
+    }
+
+    fn put_clear(&mut self, key: SerieKey, dates: (i32, i32)) -> Result<(), Error> {
+        let mut buf = Vec::new();
+        encode_clear(&mut buf, &key, dates);
+        self.writer.write_all(&buf)?;
+        self.series.entry(key).or_default().clear(dates);
+        Ok(())
+    }
+
+    fn put_point(&mut self, key: SerieKey, date: i32, value: Value) -> Result<(), Error> {
+        let mut buf = Vec::new();
+        encode_point(&mut buf, &key, date, &value);
+        self.writer.write_all(&buf)?;
+        self.series
+            .entry(key)
+            .or_default()
+            .points
+            .insert(date, value);
+        Ok(())
+    }
+
+    /// Load all records, returns the length of the valid ones
+    fn load(&mut self, bytes: &[u8]) -> usize {
+        let mut reader = Reader::new(bytes);
+        loop {
+            let start = reader.pos;
+            if reader.load_record(self).is_none() {
+                return start;
+            }
+        }
+    }
+}
+
+/// Seconds since unix epoch
+fn now() -> u64 {
+    SystemTime::now()
+        .duration_since(UNIX_EPOCH)
+        .map_or(0, |d| d.as_secs())
+}
+
+/// Which `RefData` fields can be set from a cached `Value`
+fn cacheable<R: RefData>() -> Vec<bool> {
+    let mut probe = R::default();
+    R::FIELDS
+        .iter()
+        .map(|field| probe.on_value(field, &Value::Null))
+        .collect()
+}
+
+/// Decode a `HistoricalDataRequest` response event into
+/// (security, field, date, value) points
+fn hist_data_event(
+    event: &Event,
+    points: &mut Vec<(String, String, i32, Value)>,
+    received: &mut HashSet<String>,
+) {
+    for message in event.messages().map(|m| m.element()) {
+        let security = match message.get_named_element(&name::SECURITY_DATA) {
+            Some(security) => security,
+            None => continue,
+        };
+        let ticker = security
+            .get_named_element(&name::SECURITY_NAME)
+            .and_then(|s| s.get_at(0))
+            .unwrap_or_else(String::new);
+        if security.has_named_element(&name::SECURITY_ERROR) {
+            continue;
+        }
+        if let Some(fields) = security.get_named_element(&name::FIELD_DATA) {
+            for point in fields.values::<Element>() {
+                let date = point
+                    .get_named_element(&name::DATE)
+                    .and_then(|d| d.get_at(0))
+                    .map(|d: Datetime| d.days_since_epoch());
+                let date = match date {
+                    Some(date) => date,
+                    None => continue,
+                };
+                for field in point.elements() {
+                    let field_name = field.name();
+                    if field_name == *name::DATE {
+                        continue;
+                    }
+                    if let Some(value) = Value::from_element(&field) {
+                        let field_name = field_name.to_string_lossy().into_owned();
+                        points.push((ticker.clone(), field_name, date, value));
+                    }
+                }
+            }
+        }
+        received.insert(ticker);
+    }
+}
+
+fn encode_cell(buf: &mut Vec<u8>, security: &str, field: &str, fetched: u64, value: &Value) {
+    buf.push(CELL);
+    encode_str(buf, security);
+    encode_str(buf, field);
+    buf.extend_from_slice(&fetched.to_le_bytes());
+    encode_value(buf, value);
+}
+
+fn encode_range(buf: &mut Vec<u8>, key: &SerieKey, fetched: (i32, i32), coverage: (i32, i32)) {
+    buf.push(RANGE);
+    encode_str(buf, &key.0);
+    encode_str(buf, &key.1);
+    encode_str(buf, &key.2);
+    for day in &[fetched.0, fetched.1, coverage.0, coverage.1] {
+        buf.extend_from_slice(&day.to_le_bytes());
+    }
+}
+
+fn encode_clear(buf: &mut Vec<u8>, key: &SerieKey, dates: (i32, i32)) {
+    buf.push(CLEAR);
+    encode_str(buf, &key.0);
+    encode_str(buf, &key.1);
+    encode_str(buf, &key.2);
+    buf.extend_from_slice(&dates.0.to_le_bytes());
+    buf.extend_from_slice(&dates.1.to_le_bytes());
+}
+
+fn encode_point(buf: &mut Vec<u8>, key: &SerieKey, date: i32, value: &Value) {
+    buf.push(POINT);
+    encode_str(buf, &key.0);
+    encode_str(buf, &key.1);
+    encode_str(buf, &key.2);
+    buf.extend_from_slice(&date.to_le_bytes());
+    encode_value(buf, value);
+}
+
+impl<'a> Reader<'a> {
+    fn key(&mut self) -> Option<SerieKey> {
+        Some((self.string()?, self.string()?, self.string()?))
+    }
+
+    /// Load next record into cache
+    fn load_record(&mut self, cache: &mut Cache) -> Option<()> {
+        match self.u8()? {
+            CELL => {
+                let key = (self.string()?, self.string()?);
+                let fetched = self.u64()?;
+                let value = self.value()?;
+                cache.cells.insert(key, Cell { fetched, value });
+            }
+            RANGE => {
+                let key = self.key()?;
+                let fetched = (self.i32()?, self.i32()?);
+                let coverage = (self.i32()?, self.i32()?);
+                let serie = cache.series.entry(key).or_default();
+                serie.apply_range(fetched, coverage);
+            }
+            CLEAR => {
+                let key = self.key()?;
+                let dates = (self.i32()?, self.i32()?);
+                cache.series.entry(key).or_default().clear(dates);
+            }
+            POINT => {
+                let key = self.key()?;
+                let date = self.i32()?;
+                let value = self.value()?;
+                let serie = cache.series.entry(key).or_default();
+                serie.points.insert(date, value);
+            }
+            _ => return None,
+        }
+        Some(())
+    }
+}
+
+#[test]
+fn persist() -> Result<(), Error> {
+    let path = std::env::temp_dir().join(format!("blpapi-cache-{}.test", std::process::id()));
+    let _ = fs::remove_file(&path);
+    let key = (
+        "IBM US Equity".to_owned(),
+        "PX_LAST".to_owned(),
+        String::new(),
+    );
+    {
+        let mut cache = Cache::open(&path)?;
+        let value = Value::String("USD".into());
+        cache.put_cell(key.0.clone(), "CRNCY".into(), 42, value)?;
+        cache.put_point(key.clone(), 12, Value::Float(1.5))?;
+        cache.put_range(key.clone(), (10, 20), 100)?;
+        cache.put_clear(key.clone(), (21, 30))?;
+        cache.put_point(key.clone(), 30, Value::Float(2.5))?;
+        cache.put_range(key.clone(), (21, 30), 25)?;
+        // points of a fetch cut before its range
+        cache.put_clear(key.clone(), (31, 35))?;
+        cache.put_point(key.clone(), 31, Value::Float(3.5))?;
+        cache.writer.flush()?;
+    }
+    // a partially written record
+    OpenOptions::new()
+        .append(true)
+        .open(&path)?
+        .write_all(&[CELL, 3])?;
+
+    let mut cache = Cache::open(&path)?;
+    assert_eq!(cache.cells[&(key.0.clone(), "CRNCY".into())].fetched, 42);
+    let serie = &cache.series[&key];
+    assert_eq!(serie.coverage, (10, 25));
+    assert_eq!(serie.points.keys().collect::<Vec<_>>(), vec![&12, &30, &31]);
+
+    // disjoint range replaces the coverage
+    cache.put_range(key.clone(), (40, 50), 100)?;
+    assert_eq!(cache.series[&key].coverage, (40, 50));
+    assert!(cache.series[&key].points.is_empty());
+
+    cache.compact()?;
+    let cache = Cache::open(&path)?;
+    assert_eq!(cache.series[&key].coverage, (40, 50));
+    assert_eq!(cache.cells.len(), 1);
+    fs::remove_file(&path)?;
+    Ok(())
+}
+
+#[cfg(test)]
+fn test_cache(name: &str) -> Result<(Cache, PathBuf), Error> {
+    let path =
+        std::env::temp_dir().join(format!("blpapi-cache-{}-{}.test", name, std::process::id()));
+    let _ = fs::remove_file(&path);
+    Ok((Cache::open(&path)?, path))
+}
+
+#[cfg(test)]
+#[derive(Default)]
+struct Equity {
+    crncy: Option<String>,
+    px_last: Option<f64>,
+}
+
+#[cfg(test)]
+impl RefData for Equity {
+    const FIELDS: &'static [&'static str] = &["CRNCY", "PX_LAST"];
+    fn on_field(&mut self, _field: &str, _element: &Element) {}
+    fn on_value(&mut self, field: &str, value: &Value) -> bool {
+        use crate::value::{SetFromValue, Slot};
+        match field {
+            "CRNCY" => (&&Slot::new(&mut self.crncy)).set_value(value),
+            _ => (&&Slot::new(&mut self.px_last)).set_value(value),
+        }
+    }
+}
+
+#[test]
+fn ttl_expiry() -> Result<(), Error> {
+    let (cache, path) = test_cache("ttl")?;
+    let mut cache = cache
+        .with_default_ttl(Duration::from_secs(100))
+        .with_ttl("PX_LAST", Duration::from_secs(10));
+    cache.put_cell(
+        "IBM".into(),
+        "CRNCY".into(),
+        1000,
+        Value::String("USD".into()),
+    )?;
+    cache.put_cell("IBM".into(), "PX_LAST".into(), 1000, Value::Float(1.5))?;
+
+    let fresh = |cache: &Cache, now| {
+        (
+            cache.fresh("IBM", "CRNCY", now).is_some(),
+            cache.fresh("IBM", "PX_LAST", now).is_some(),
+        )
+    };
+    assert_eq!(fresh(&cache, 1005), (true, true));
+    assert_eq!(fresh(&cache, 1010), (true, false));
+    assert_eq!(fresh(&cache, 1100), (false, false));
+    assert!(cache.fresh("MSFT", "CRNCY", 1005).is_none());
+    fs::remove_file(&path)?;
+    Ok(())
+}
+
+#[test]
+fn missing_fields() -> Result<(), Error> {
+    let (mut cache, path) = test_cache("fields")?;
+    let usd = || Value::String("USD".into());
+    cache.put_cell("IBM".into(), "CRNCY".into(), 1000, usd())?;
+    cache.put_cell("IBM".into(), "PX_LAST".into(), 1000, Value::Null)?;
+    cache.put_cell("MSFT".into(), "CRNCY".into(), 1000, usd())?;
+    cache.put_cell("VOD".into(), "CRNCY".into(), 1000, usd())?;
+    cache.put_cell(
+        "VOD".into(),
+        "PX_LAST".into(),
+        1000,
+        Value::String("n/a".into()),
+    )?;
+
+    let mut ref_data = HashMap::new();
+    let securities = &["IBM", "MSFT", "AAPL", "VOD"];
+    let missing = cache.missing_fields::<_, Equity>(securities, &[true, true], 1005, &mut ref_data);
+    assert_eq!(missing.len(), 2);
+    assert_eq!(missing[&vec!["PX_LAST"]], vec!["MSFT", "VOD"]);
+    assert_eq!(missing[&vec!["CRNCY", "PX_LAST"]], vec!["AAPL"]);
+    assert_eq!(ref_data["IBM"].crncy.as_deref(), Some("USD"));
+    assert_eq!(ref_data["IBM"].px_last, None);
+
+    // non cacheable fields are always requested
+    let missing = cache.missing_fields::<_, Equity>(&["IBM"], &[true, false], 1005, &mut ref_data);
+    assert_eq!(missing[&vec!["PX_LAST"]], vec!["IBM"]);
+
+    // expired values are requested again
+    let missing =
+        cache.missing_fields::<_, Equity>(&["IBM"], &[true, true], 1_000_000, &mut ref_data);
+    assert_eq!(missing[&vec!["CRNCY", "PX_LAST"]], vec!["IBM"]);
+    fs::remove_file(&path)?;
+    Ok(())
+}
+
+#[test]
+fn missing_dates() -> Result<(), Error> {
+    let (mut cache, path) = test_cache("dates")?;
+    let key = |security: &str, field: &str| (security.to_owned(), field.to_owned(), String::new());
+    cache.put_range(key("IBM", "PX_LAST"), (10, 20), 100)?;
+    cache.put_range(key("IBM", "PX_OPEN"), (10, 20), 100)?;
+    cache.put_range(key("MSFT", "PX_LAST"), (10, 20), 100)?;
+    cache.put_range(key("MSFT", "PX_OPEN"), (15, 30), 100)?;
+    cache.put_range(key("VOD", "PX_LAST"), (40, 50), 100)?;
+    cache.put_range(key("VOD", "PX_OPEN"), (40, 50), 100)?;
+
+    let securities = ["IBM", "MSFT", "AAPL", "VOD"]
+        .iter()
+        .map(|s| s.to_string())
+        .collect::<Vec<_>>();
+    let fields = &["PX_LAST", "PX_OPEN"];
+    let mut missing = cache.missing_dates(&securities, fields, "", (5, 25));
+    missing.values_mut().for_each(|s| s.sort());
+    assert_eq!(missing.len(), 4);
+    assert_eq!(missing[&(5, 9)], vec!["IBM"]);
+    assert_eq!(missing[&(21, 25)], vec!["IBM", "MSFT"]);
+    assert_eq!(missing[&(5, 14)], vec!["MSFT"]);
+    assert_eq!(missing[&(5, 25)], vec!["AAPL", "VOD"]);
+
+    // fully covered
+    assert!(cache
+        .missing_dates(&securities[..2], fields, "", (16, 19))
+        .is_empty());
+    // another options key is not covered
+    let missing = cache.missing_dates(&securities[..1], fields, "MONTHLY", (16, 19));
+    assert_eq!(missing[&(16, 19)], vec!["IBM"]);
+    fs::remove_file(&path)?;
+    Ok(())
+}
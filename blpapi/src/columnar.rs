@@ -0,0 +1,538 @@
+//! Columnar historical data
+//!
+//! Values are decoded straight into contiguous, per-field buffers laid out as
+//! arrow arrays (values + LSB ordered validity bitmap, `i32` offsets for
+//! strings, `date32` for dates). They can be handed over to an arrow
+//! implementation without copy (e.g. `Buffer::from_vec`) or written as is
+//! to an arrow IPC file or memory-mapped region.
+
+use crate::{
+    datetime::Datetime,
+    element::{DataType, Element},
+    event::Event,
+    name,
+    ref_data::FieldIndex,
+};
+use std::collections::{hash_map::Entry, HashMap};
+
+/// A validity bitmap, one bit per value, least significant bit first
+#[derive(Debug, Default, Clone)]
+pub struct Bitmap {
+    bytes: Vec<u8>,
+    len: usize,
+}
+
+impl Bitmap {
+    /// Create a new bitmap with given capacity (in bits)
+    pub fn with_capacity(capacity: usize) -> Self {
+        Bitmap {
+            bytes: Vec::with_capacity((capacity + 7) / 8),
+            len: 0,
+        }
+    }
+
+    /// Append a new bit
+    pub fn push(&mut self, bit: bool) {
+        if self.len % 8 == 0 {
+            self.bytes.push(0);
+        }
+        if bit {
+            self.bytes[self.len / 8] |= 1 << (self.len % 8);
+        }
+        self.len += 1;
+    }
+
+    /// Get bit at index
+    pub fn get(&self, index: usize) -> bool {
+        index < self.len && self.bytes[index / 8] & (1 << (index % 8)) != 0
+    }
+
+    /// Number of bits
+    pub fn len(&self) -> usize {
+        self.len
+    }
+
+    /// Is empty
+    pub fn is_empty(&self) -> bool {
+        self.len == 0
+    }
+
+    /// Number of unset bits
+    pub fn count_zeros(&self) -> usize {
+        let ones: u32 = self.bytes.iter().map(|b| b.count_ones()).sum();
+        self.len - ones as usize
+    }
+
+    /// Get the underlying bytes
+    pub fn as_bytes(&self) -> &[u8] {
+        &self.bytes
+    }
+}
+
+mod sealed {
+    pub trait Sealed {}
+    impl Sealed for f64 {}
+    impl Sealed for i64 {}
+    impl Sealed for i32 {}
+}
+
+/// A primitive value without padding, which can be viewed as raw bytes
+pub trait Primitive: sealed::Sealed + Copy + Default {}
+
+impl Primitive for f64 {}
+impl Primitive for i64 {}
+impl Primitive for i32 {}
+
+/// A nullable array of primitive values
+#[derive(Debug, Default, Clone)]
+pub struct PrimitiveArray<T> {
+    values: Vec<T>,
+    validity: Bitmap,
+}
+
+impl<T: Primitive> PrimitiveArray<T> {
+    fn with_nulls(capacity: usize, nulls: usize) -> Self {
+        let mut array = PrimitiveArray {
+            values: Vec::with_capacity(capacity),
+            validity: Bitmap::with_capacity(capacity),
+        };
+        for _ in 0..nulls {
+            array.push(None);
+        }
+        array
+    }
+
+    fn push(&mut self, value: Option<T>) {
+        self.values.push(value.unwrap_or_default());
+        self.validity.push(value.is_some());
+    }
+
+    /// Get value at index, if not null
+    pub fn get(&self, index: usize) -> Option<T> {
+        if self.validity.get(index) {
+            Some(self.values[index])
+        } else {
+            None
+        }
+    }
+
+    /// Get the values, null values are set to `T::default()`
+    pub fn values(&self) -> &[T] {
+        &self.values
+    }
+
+    /// Get the validity bitmap
+    pub fn validity(&self) -> &Bitmap {
+        &self.validity
+    }
+
+    /// Copy the values at `rows`, null where `None`
+    fn gather(&self, rows: impl ExactSizeIterator<Item = Option<usize>>) -> Self {
+        let mut array = PrimitiveArray::with_nulls(rows.len(), 0);
+        for row in rows {
+            array.push(row.and_then(|i| self.get(i)));
+        }
+        array
+    }
+
+    /// View the values as raw bytes, e.g. to write an arrow buffer
+    pub fn values_bytes(&self) -> &[u8] {
+        // `Primitive` types have no padding: every byte is initialized
+        unsafe {
+            std::slice::from_raw_parts(
+                self.values.as_ptr() as *const u8,
+                self.values.len() * std::mem::size_of::<T>(),
+            )
+        }
+    }
+}
+
+/// A nullable array of booleans, packed as a bitmap
+#[derive(Debug, Default, Clone)]
+pub struct BooleanArray {
+    pub values: Bitmap,
+    pub validity: Bitmap,
+}
+
+impl BooleanArray {
+    fn with_nulls(capacity: usize, nulls: usize) -> Self {
+        let mut array = BooleanArray {
+            values: Bitmap::with_capacity(capacity),
+            validity: Bitmap::with_capacity(capacity),
+        };
+        for _ in 0..nulls {
+            array.push(None);
+        }
+        array
+    }
+
+    fn push(&mut self, value: Option<bool>) {
+        self.values.push(value.unwrap_or_default());
+        self.validity.push(value.is_some());
+    }
+
+    /// Get value at index, if not null
+    pub fn get(&self, index: usize) -> Option<bool> {
+        if self.validity.get(index) {
+            Some(self.values.get(index))
+        } else {
+            None
+        }
+    }
+
+    /// Copy the values at `rows`, null where `None`
+    fn gather(&self, rows: impl ExactSizeIterator<Item = Option<usize>>) -> Self {
+        let mut array = BooleanArray::with_nulls(rows.len(), 0);
+        for row in rows {
+            array.push(row.and_then(|i| self.get(i)));
+        }
+        array
+    }
+}
+
+/// A nullable array of utf8 strings
+#[derive(Debug, Clone)]
+pub struct StringArray {
+    /// `len + 1` offsets in `data`
+    pub offsets: Vec<i32>,
+    pub data: Vec<u8>,
+    pub validity: Bitmap,
+}
+
+impl StringArray {
+    fn with_nulls(capacity: usize, nulls: usize) -> Self {
+        let mut offsets = Vec::with_capacity(capacity + 1);
+        offsets.push(0);
+        let mut array = StringArray {
+            offsets,
+            data: Vec::new(),
+            validity: Bitmap::with_capacity(capacity),
+        };
+        for _ in 0..nulls {
+            array.push(None);
+        }
+        array
+    }
+
+    fn push(&mut self, value: Option<&str>) {
+        if let Some(value) = value {
+            self.data.extend_from_slice(value.as_bytes());
+        }
+        self.offsets.push(self.data.len() as i32);
+        self.validity.push(value.is_some());
+    }
+
+    /// Get value at index, if not null
+    pub fn get(&self, index: usize) -> Option<&str> {
+        if self.validity.get(index) {
+            let (start, end) = (self.offsets[index], self.offsets[index + 1]);
+            std::str::from_utf8(&self.data[start as usize..end as usize]).ok()
+        } else {
+            None
+        }
+    }
+
+    /// Copy the values at `rows`, null where `None`
+    fn gather(&self, rows: impl ExactSizeIterator<Item = Option<usize>>) -> Self {
+        let mut array = StringArray::with_nulls(rows.len(), 0);
+        for row in rows {
+            array.push(row.and_then(|i| self.get(i)));
+        }
+        array
+    }
+}
+
+/// A column of values of a given field
+///
+/// Its type is decided by the first non null value.
+#[derive(Debug, Clone)]
+pub enum Column {
+    /// Only null values so far
+    Null(usize),
+    Float64(PrimitiveArray<f64>),
+    Int64(PrimitiveArray<i64>),
+    /// Days since 1970-01-01
+    Date32(PrimitiveArray<i32>),
+    Boolean(BooleanArray),
+    Utf8(StringArray),
+}
+
+impl Column {
+    /// Number of values
+    pub fn len(&self) -> usize {
+        match self {
+            Column::Null(len) => *len,
+            Column::Float64(a) => a.values.len(),
+            Column::Int64(a) => a.values.len(),
+            Column::Date32(a) => a.values.len(),
+            Column::Boolean(a) => a.validity.len(),
+            Column::Utf8(a) => a.validity.len(),
+        }
+    }
+
+    /// Is empty
+    pub fn is_empty(&self) -> bool {
+        self.len() == 0
+    }
+
+    /// Get validity bitmap, if any value is not null
+    pub fn validity(&self) -> Option<&Bitmap> {
+        match self {
+            Column::Null(_) => None,
+            Column::Float64(a) => Some(&a.validity),
+            Column::Int64(a) => Some(&a.validity),
+            Column::Date32(a) => Some(&a.validity),
+            Column::Boolean(a) => Some(&a.validity),
+            Column::Utf8(a) => Some(&a.validity),
+        }
+    }
+
+    fn push_null(&mut self) {
+        match self {
+            Column::Null(len) => *len += 1,
+            Column::Float64(a) => a.push(None),
+            Column::Int64(a) => a.push(None),
+            Column::Date32(a) => a.push(None),
+            Column::Boolean(a) => a.push(None),
+            Column::Utf8(a) => a.push(None),
+        }
+    }
+
+    /// Push nulls until the column has `len` values
+    fn fill_to(&mut self, len: usize) {
+        for _ in self.len()..len {
+            self.push_null();
+        }
+    }
+
+    /// Copy the values at `rows`, null where `None`
+    fn gather(&self, rows: impl ExactSizeIterator<Item = Option<usize>>) -> Column {
+        match self {
+            Column::Null(_) => Column::Null(rows.len()),
+            Column::Float64(a) => Column::Float64(a.gather(rows)),
+            Column::Int64(a) => Column::Int64(a.gather(rows)),
+            Column::Date32(a) => Column::Date32(a.gather(rows)),
+            Column::Boolean(a) => Column::Boolean(a.gather(rows)),
+            Column::Utf8(a) => Column::Utf8(a.gather(rows)),
+        }
+    }
+
+    /// Push the value of `element`, converted to the column type
+    fn push(&mut self, element: &Element, capacity: usize) {
+        if let Column::Null(nulls) = *self {
+            *self = match element.datatype() {
+                DataType::Float32 | DataType::Float64 | DataType::Decimal => {
+                    Column::Float64(PrimitiveArray::with_nulls(capacity, nulls))
+                }
+                DataType::Int32 | DataType::Int64 | DataType::Byte | DataType::Char => {
+                    Column::Int64(PrimitiveArray::with_nulls(capacity, nulls))
+                }
+                DataType::Date | DataType::Datetime => {
+                    Column::Date32(PrimitiveArray::with_nulls(capacity, nulls))
+                }
+                DataType::Bool => Column::Boolean(BooleanArray::with_nulls(capacity, nulls)),
+                _ => Column::Utf8(StringArray::with_nulls(capacity, nulls)),
+            };
+        }
+        match self {
+            Column::Null(_) => unreachable!(),
+            Column::Float64(a) => a.push(element.get_at(0)),
+            Column::Int64(a) => a.push(element.get_at(0)),
+            Column::Date32(a) => a.push(element.get_at(0).map(|d: Datetime| d.days_since_epoch())),
+            Column::Boolean(a) => a.push(element.get_at(0)),
+            Column::Utf8(a) => a.push(element.get_str_at(0)),
+        }
+    }
+}
+
+/// Historical data of a security, one column per field
+#[derive(Debug, Clone)]
+pub struct Columns {
+    /// Days since 1970-01-01
+    pub dates: PrimitiveArray<i32>,
+    /// Columns, in the requested fields order
+    pub columns: Vec<Column>,
+}
+
+impl Columns {
+    fn new(num_fields: usize, capacity: usize) -> Self {
+        Columns {
+            dates: PrimitiveArray::with_nulls(capacity, 0),
+            columns: (0..num_fields).map(|_| Column::Null(0)).collect(),
+        }
+    }
+
+    /// Number of rows
+    pub fn len(&self) -> usize {
+        self.dates.values.len()
+    }
+
+    /// Is empty
+    pub fn is_empty(&self) -> bool {
+        self.len() == 0
+    }
+
+    /// Merge the rows of `other`, holding another chunk of fields of the same
+    /// security, by date
+    ///
+    /// Both are sorted by date. Rows without a date cannot be matched, the
+    /// rows of `other` are then appended. The dates are mapped onto the merged
+    /// rows once, and columns are only copied when rows were inserted into
+    /// their chunk: chunks of the same dates are merged without any copy.
+    fn merge(&mut self, other: Columns) {
+        let (left, right) = (&self.dates, &other.dates);
+        let mut rows = Vec::with_capacity(left.values.len().max(right.values.len()));
+        if left.validity.count_zeros() > 0 || right.validity.count_zeros() > 0 {
+            rows.extend((0..left.values.len()).map(|i| (Some(i), None)));
+            rows.extend((0..right.values.len()).map(|i| (None, Some(i))));
+        } else {
+            let (mut i, mut j) = (0, 0);
+            while i < left.values.len() || j < right.values.len() {
+                let row = match (left.values.get(i), right.values.get(j)) {
+                    (Some(l), Some(r)) if l == r => (Some(i), Some(j)),
+                    (Some(l), Some(r)) if l > r => (None, Some(j)),
+                    (Some(_), _) => (Some(i), None),
+                    (None, _) => (None, Some(j)),
+                };
+                i += row.0.is_some() as usize;
+                j += row.1.is_some() as usize;
+                rows.push(row);
+            }
+        }
+
+        // rows are sorted, a chunk with a row everywhere is left as is
+        let all_left = rows.iter().all(|row| row.0.is_some());
+        let all_right = rows.iter().all(|row| row.1.is_some());
+        if !all_left {
+            self.dates = if all_right {
+                other.dates
+            } else {
+                let mut dates = PrimitiveArray::with_nulls(rows.len(), 0);
+                for (i, j) in &rows {
+                    dates.push(
+                        i.and_then(|i| self.dates.get(i))
+                            .or_else(|| j.and_then(|j| other.dates.get(j))),
+                    );
+                }
+                dates
+            };
+        }
+        // each field is in a single chunk, thus null in the other one
+        for (l, r) in self.columns.iter_mut().zip(other.columns) {
+            match l {
+                Column::Null(_) if all_right => *l = r,
+                Column::Null(_) => *l = r.gather(rows.iter().map(|row| row.1)),
+                _ if all_left => (),
+                _ => *l = l.gather(rows.iter().map(|row| row.0)),
+            }
+        }
+    }
+}
+
+/// Decode a `HistoricalDataRequest` response event into `columns`
+///
+/// Securities requested in several chunks of fields are merged by date.
+pub(crate) fn hist_data_event(
+    event: &Event,
+    index: &FieldIndex,
+    columns: &mut HashMap<String, Columns>,
+) {
+    for message in event.messages().map(|m| m.element()) {
+        if let Some(security) = message.get_named_element(&name::SECURITY_DATA) {
+            let ticker = security
+                .get_named_element(&name::SECURITY_NAME)
+                .and_then(|s| s.get_at(0))
+                .unwrap_or_else(String::new);
+            if security.has_named_element(&name::SECURITY_ERROR) {
+                continue;
+            }
+            if let Some(fields) = security.get_named_element(&name::FIELD_DATA) {
+                let chunk = decode_points(&fields, index);
+                match columns.entry(ticker) {
+                    Entry::Occupied(mut entry) => entry.get_mut().merge(chunk),
+                    Entry::Vacant(entry) => {
+                        entry.insert(chunk);
+                    }
+                }
+            }
+        }
+    }
+}
+
+/// Decode the `fieldData` points of a security, one row per point
+fn decode_points(fields: &Element, index: &FieldIndex) -> Columns {
+    let capacity = fields.num_values();
+    let mut columns = Columns::new(index.names().len(), capacity);
+    for point in fields.values::<Element>() {
+        let row = columns.len();
+        for field in point.elements() {
+            let field_name = field.name();
+            if field_name == *name::DATE {
+                let date: Option<Datetime> = field.get_at(0);
+                columns.dates.push(date.map(|d| d.days_since_epoch()));
+            } else if let Some(i) = index.get(&field_name) {
+                let column = &mut columns.columns[i];
+                column.fill_to(row);
+                column.push(&field, capacity);
+            }
+        }
+        if columns.len() == row {
+            columns.dates.push(None);
+        }
+        for column in &mut columns.columns {
+            column.fill_to(row + 1);
+        }
+    }
+    columns
+}
+
+#[test]
+fn bitmap() {
+    let mut bitmap = Bitmap::default();
+    for i in 0..10 {
+        bitmap.push(i % 3 == 0);
+    }
+    assert_eq!(bitmap.as_bytes(), &[0b0100_1001, 0b10]);
+    assert!(bitmap.get(9));
+    assert!(!bitmap.get(10));
+    assert_eq!(bitmap.count_zeros(), 6);
+}
+
+#[test]
+fn merge_chunks() {
+    // 30 fields: the first 25 in a chunk, the last 5 in another one
+    let chunk = |days: &[i32], fields: std::ops::Range<usize>| {
+        let mut columns = Columns::new(30, days.len());
+        for day in days {
+            columns.dates.push(Some(*day));
+        }
+        for i in fields {
+            let mut array = PrimitiveArray::with_nulls(days.len(), 0);
+            for day in days {
+                array.push(Some(*day as f64));
+            }
+            columns.columns[i] = Column::Float64(array);
+        }
+        columns
+    };
+    let mut columns = chunk(&[2, 4, 7], 0..25);
+    columns.merge(chunk(&[2, 3, 7], 25..30));
+
+    assert_eq!(columns.dates.values(), &[2, 3, 4, 7]);
+    assert!(columns.columns.iter().all(|c| c.len() == 4));
+    let get = |column: usize, row| match &columns.columns[column] {
+        Column::Float64(a) => a.get(row),
+        _ => None,
+    };
+    assert_eq!((get(0, 0), get(29, 0)), (Some(2.), Some(2.)));
+    assert_eq!((get(0, 1), get(29, 1)), (None, Some(3.)));
+    assert_eq!((get(0, 2), get(29, 2)), (Some(4.), None));
+    assert_eq!((get(24, 3), get(25, 3)), (Some(7.), Some(7.)));
+
+    // same dates: the columns of both chunks are moved
+    let mut columns = chunk(&[2, 4, 7], 0..25);
+    columns.merge(chunk(&[2, 4, 7], 25..30));
+    assert_eq!(columns.dates.values(), &[2, 4, 7]);
+    assert!(columns.columns.iter().all(|c| c.len() == 3));
+    assert_eq!(columns.dates.values_bytes().len(), 12);
+}
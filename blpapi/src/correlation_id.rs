@@ -21,10 +21,20 @@ impl CorrelationId {
         let inner = blpapi_CorrelationId_t_ { value, _bitfield_1 };
         CorrelationId(inner)
     }
+
+    /// Get the integer value, if this correlation id was created from a `u64`
+    pub fn value_u64(&self) -> Option<u64> {
+        if self.0.valueType() == BLPAPI_CORRELATION_TYPE_INT {
+            unsafe { Some(self.0.value.intValue) }
+        } else {
+            None
+        }
+    }
 }
 
 #[test]
 fn correlation_u64() {
     let id = CorrelationId::new_u64(1);
     assert_eq!(unsafe { id.0.value.intValue }, 1);
+    assert_eq!(id.value_u64(), Some(1));
 }
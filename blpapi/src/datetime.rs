@@ -1,6 +1,7 @@
 use blpapi_sys::*;
 use std::os::raw::c_int;
 
+#[derive(Clone, Copy)]
 pub struct Datetime(pub(crate) blpapi_Datetime_t);
 
 impl Default for Datetime {
@@ -19,6 +20,169 @@ impl Default for Datetime {
     }
 }
 
+impl Datetime {
+    /// Create a new date
+    pub fn from_ymd(year: u16, month: u8, day: u8) -> Self {
+        let mut datetime = Datetime::default();
+        datetime.0.parts = BLPAPI_DATETIME_DATE_PART as u8;
+        datetime.0.year = year;
+        datetime.0.month = month;
+        datetime.0.day = day;
+        datetime
+    }
+
+    /// Create a new date from a number of days since 1970-01-01
+    pub fn from_days_since_epoch(days: i32) -> Self {
+        let (y, m, d) = civil_from_days(days);
+        Datetime::from_ymd(y as u16, m as u8, d as u8)
+    }
+
+    /// Create a new date and time
+    pub fn from_ymd_hms(
+        year: u16,
+        month: u8,
+        day: u8,
+        hours: u8,
+        minutes: u8,
+        seconds: u8,
+    ) -> Self {
+        let mut datetime = Datetime::from_ymd(year, month, day);
+        datetime.0.parts |= BLPAPI_DATETIME_TIME_PART as u8;
+        datetime.0.hours = hours;
+        datetime.0.minutes = minutes;
+        datetime.0.seconds = seconds;
+        datetime
+    }
+
+    /// Create a new UTC date and time from a number of seconds since 1970-01-01
+    pub fn from_epoch_seconds(seconds: i64) -> Self {
+        let (days, seconds) = (seconds.div_euclid(86_400), seconds.rem_euclid(86_400));
+        let (y, m, d) = civil_from_days(days as i32);
+        Datetime::from_ymd_hms(
+            y as u16,
+            m as u8,
+            d as u8,
+            (seconds / 3600) as u8,
+            (seconds / 60 % 60) as u8,
+            (seconds % 60) as u8,
+        )
+    }
+
+    /// Number of days since 1970-01-01 (arrow `date32`)
+    pub fn days_since_epoch(&self) -> i32 {
+        days_from_civil(self.0.year as i32, self.0.month as i32, self.0.day as i32)
+    }
+
+    /// Nanoseconds since 1970-01-01 UTC, `None` if there is no date part
+    pub fn epoch_nanos(&self) -> Option<i64> {
+        epoch_nanos(&self.0, 0)
+    }
+}
+
+/// A datetime with picoseconds precision, e.g. tick times
+#[derive(Clone, Copy)]
+pub struct HighPrecisionDatetime(pub(crate) blpapi_HighPrecisionDatetime_t);
+
+impl Default for HighPrecisionDatetime {
+    fn default() -> Self {
+        HighPrecisionDatetime(blpapi_HighPrecisionDatetime_t {
+            datetime: Datetime::default().0,
+            picoseconds: 0,
+        })
+    }
+}
+
+impl From<Datetime> for HighPrecisionDatetime {
+    fn from(datetime: Datetime) -> Self {
+        HighPrecisionDatetime(blpapi_HighPrecisionDatetime_t {
+            datetime: datetime.0,
+            picoseconds: 0,
+        })
+    }
+}
+
+impl HighPrecisionDatetime {
+    /// Datetime, with milliseconds precision
+    pub fn datetime(&self) -> Datetime {
+        Datetime(self.0.datetime)
+    }
+
+    /// Picoseconds, on top of the datetime milliseconds
+    pub fn picoseconds(&self) -> u32 {
+        self.0.picoseconds
+    }
+
+    /// Nanoseconds since 1970-01-01 UTC, `None` if there is no date part
+    pub fn epoch_nanos(&self) -> Option<i64> {
+        epoch_nanos(&self.0.datetime, self.0.picoseconds)
+    }
+
+    /// Date and time, in the value time zone
+    #[cfg(feature = "dates")]
+    pub fn to_naive_datetime(&self) -> Option<chrono::NaiveDateTime> {
+        let d = &self.0.datetime;
+        if d.parts as u32 & BLPAPI_DATETIME_DATE_PART != BLPAPI_DATETIME_DATE_PART {
+            return None;
+        }
+        let nanos = d.milliSeconds as u32 * 1_000_000 + self.0.picoseconds / 1_000;
+        chrono::NaiveDate::from_ymd_opt(d.year as i32, d.month as u32, d.day as u32)?
+            .and_hms_nano_opt(d.hours as u32, d.minutes as u32, d.seconds as u32, nanos)
+    }
+
+    /// UTC date and time
+    #[cfg(feature = "dates")]
+    pub fn to_utc(&self) -> Option<chrono::DateTime<chrono::Utc>> {
+        let offset = if self.0.datetime.parts as u32 & BLPAPI_DATETIME_OFFSET_PART != 0 {
+            self.0.datetime.offset as i64
+        } else {
+            0
+        };
+        let utc = self.to_naive_datetime()? - chrono::Duration::minutes(offset);
+        Some(chrono::TimeZone::from_utc_datetime(&chrono::Utc, &utc))
+    }
+}
+
+/// Nanoseconds since 1970-01-01 UTC of a datetime (and its extra picoseconds)
+fn epoch_nanos(d: &blpapi_Datetime_t, picoseconds: u32) -> Option<i64> {
+    if d.parts as u32 & BLPAPI_DATETIME_DATE_PART != BLPAPI_DATETIME_DATE_PART {
+        return None;
+    }
+    let days = days_from_civil(d.year as i32, d.month as i32, d.day as i32) as i64;
+    let offset = if d.parts as u32 & BLPAPI_DATETIME_OFFSET_PART != 0 {
+        d.offset as i64
+    } else {
+        0
+    };
+    let minutes = days * 24 * 60 + d.hours as i64 * 60 + d.minutes as i64 - offset;
+    let millis = (minutes * 60 + d.seconds as i64) * 1_000 + d.milliSeconds as i64;
+    Some(millis * 1_000_000 + picoseconds as i64 / 1_000)
+}
+
+/// Number of days since 1970-01-01 of a proleptic gregorian date
+pub(crate) fn days_from_civil(y: i32, m: i32, d: i32) -> i32 {
+    let y = if m <= 2 { y - 1 } else { y };
+    let era = (if y >= 0 { y } else { y - 399 }) / 400;
+    let yoe = y - era * 400;
+    let mp = (m + 9) % 12;
+    let doy = (153 * mp + 2) / 5 + d - 1;
+    let doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    era * 146_097 + doe - 719_468
+}
+
+/// Proleptic gregorian date (year, month, day) of a number of days since 1970-01-01
+pub(crate) fn civil_from_days(days: i32) -> (i32, i32, i32) {
+    let z = days + 719_468;
+    let era = (if z >= 0 { z } else { z - 146_096 }) / 146_097;
+    let doe = z - era * 146_097;
+    let yoe = (doe - doe / 1460 + doe / 36_524 - doe / 146_096) / 365;
+    let doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    let mp = (5 * doy + 2) / 153;
+    let d = doy - (153 * mp + 2) / 5 + 1;
+    let m = if mp < 10 { mp + 3 } else { mp - 9 };
+    let y = yoe + era * 400 + if m <= 2 { 1 } else { 0 };
+    (y, m, d)
+}
+
 pub enum DatetimeParts {
     Year,
     Month,
@@ -83,3 +247,45 @@ impl std::fmt::Debug for Datetime {
         }
     }
 }
+
+#[test]
+fn days_since_epoch() {
+    assert_eq!(days_from_civil(1970, 1, 1), 0);
+    assert_eq!(days_from_civil(2000, 3, 1), 11_017);
+    assert_eq!(days_from_civil(1969, 12, 31), -1);
+    for &days in &[-1, 0, 59, 11_017, 18_262] {
+        let (y, m, d) = civil_from_days(days);
+        assert_eq!(days_from_civil(y, m, d), days);
+    }
+    assert_eq!(civil_from_days(11_017), (2000, 3, 1));
+}
+
+#[test]
+fn epoch_seconds() {
+    let d = Datetime::from_epoch_seconds(11_017 * 86_400 + 3_723);
+    assert_eq!(format!("{:?}", d), "2000-03-01 01:02:03.000");
+    assert_eq!(
+        d.epoch_nanos(),
+        Some((11_017 * 86_400 + 3_723) * 1_000_000_000)
+    );
+    assert_eq!(
+        format!("{:?}", Datetime::from_epoch_seconds(-1)),
+        "1969-12-31 23:59:59.000"
+    );
+}
+
+#[test]
+fn high_precision_epoch_nanos() {
+    let mut d = HighPrecisionDatetime::default();
+    assert_eq!(d.epoch_nanos(), None);
+    d.0.datetime = Datetime::from_ymd(2000, 3, 1).0;
+    d.0.datetime.parts |= (BLPAPI_DATETIME_TIMEMILLI_PART | BLPAPI_DATETIME_OFFSET_PART) as u8;
+    d.0.datetime.hours = 1;
+    d.0.datetime.milliSeconds = 2;
+    d.0.datetime.offset = 60;
+    d.0.picoseconds = 3_000;
+    assert_eq!(
+        d.epoch_nanos(),
+        Some(11_017 * 86_400_000_000_000 + 2_000_003)
+    );
+}
@@ -1,21 +1,34 @@
-use crate::{datetime::Datetime, name::Name, Error};
-use blpapi_sys::*;
-use std::{
-    ffi::{CStr, CString},
-    marker::PhantomData,
-    os::raw::c_int,
-    ptr,
+use crate::{
+    datetime::{Datetime, HighPrecisionDatetime},
+    name::{self, Name},
+    Error,
 };
+use blpapi_sys::*;
+use std::{ffi::CStr, marker::PhantomData, os::raw::c_int, ptr};
 
 /// An element
-pub struct Element {
+///
+/// A handle on an element owned by a message (or a request), valid for the
+/// lifetime `'a` of its owner. Child elements and borrowed values (e.g.
+/// `get_str_at`) share that lifetime.
+#[derive(Clone, Copy)]
+pub struct Element<'a> {
     pub(crate) ptr: *mut blpapi_Element_t,
+    _owner: PhantomData<&'a ()>,
 }
 
-impl Element {
+impl<'a> Element<'a> {
+    /// Create a new handle on an element owned by `'a`
+    pub(crate) unsafe fn new(ptr: *mut blpapi_Element_t) -> Self {
+        Element {
+            ptr,
+            _owner: PhantomData,
+        }
+    }
+
     unsafe fn opt(res: c_int, ptr: *mut blpapi_Element_t) -> Option<Self> {
         if res == 0 {
-            Some(Element { ptr })
+            Some(Element::new(ptr))
         } else {
             log::warn!("cannot find element: '{}'", res);
             None
@@ -35,9 +48,10 @@ impl Element {
 
     /// Has element
     pub fn has_element(&self, name: &str) -> bool {
-        let name = CString::new(name).unwrap();
         let named = ptr::null();
-        unsafe { blpapi_Element_hasElement(self.ptr, name.as_ptr(), named) != 0 }
+        name::with_c_str(name, |name| unsafe {
+            blpapi_Element_hasElement(self.ptr, name, named) != 0
+        })
     }
 
     /// Has element
@@ -46,6 +60,21 @@ impl Element {
         unsafe { blpapi_Element_hasElement(self.ptr, name, named.0) != 0 }
     }
 
+    /// Data type
+    pub fn datatype(&self) -> DataType {
+        unsafe { blpapi_Element_datatype(self.ptr).into() }
+    }
+
+    /// Is array
+    pub fn is_array(&self) -> bool {
+        unsafe { blpapi_Element_isArray(self.ptr) != 0 }
+    }
+
+    /// Is null
+    pub fn is_null(&self) -> bool {
+        unsafe { blpapi_Element_isNull(self.ptr) != 0 }
+    }
+
     /// Number of values
     pub fn num_values(&self) -> usize {
         unsafe { blpapi_Element_numValues(self.ptr) }
@@ -57,22 +86,17 @@ impl Element {
     }
 
     /// Get element from its name
-    pub fn get_element(&self, name: &str) -> Option<Element> {
-        unsafe {
+    pub fn get_element(&self, name: &str) -> Option<Element<'a>> {
+        name::with_c_str(name, |name| unsafe {
             let mut element = ptr::null_mut();
-            let name = CString::new(name).unwrap();
-            let res = blpapi_Element_getElement(
-                self.ptr,
-                &mut element as *mut _,
-                name.as_ptr(),
-                ptr::null(),
-            );
+            let res =
+                blpapi_Element_getElement(self.ptr, &mut element as *mut _, name, ptr::null());
             Element::opt(res, element)
-        }
+        })
     }
 
     /// Get element from its name
-    pub fn get_named_element(&self, named_element: &Name) -> Option<Element> {
+    pub fn get_named_element(&self, named_element: &Name) -> Option<Element<'a>> {
         unsafe {
             let mut element = ptr::null_mut();
             let res = blpapi_Element_getElement(
@@ -86,7 +110,7 @@ impl Element {
     }
 
     /// Get element at index
-    pub fn get_element_at(&self, index: usize) -> Option<Element> {
+    pub fn get_element_at(&self, index: usize) -> Option<Element<'a>> {
         unsafe {
             let mut element = ptr::null_mut();
             let res = blpapi_Element_getElementAt(self.ptr, &mut element as *mut _, index);
@@ -95,11 +119,11 @@ impl Element {
     }
 
     /// Append a new element
-    pub fn append_element(&mut self) -> Result<Element, Error> {
+    pub fn append_element(&mut self) -> Result<Element<'a>, Error> {
         unsafe {
             let mut ptr = ptr::null_mut();
             Error::check(blpapi_Element_appendElement(self.ptr, &mut ptr as *mut _))?;
-            Ok(Element { ptr })
+            Ok(Element::new(ptr))
         }
     }
 
@@ -109,7 +133,7 @@ impl Element {
     }
 
     /// Get value at given index
-    pub fn get_at<V: GetValue>(&self, index: usize) -> Option<V> {
+    pub fn get_at<V: GetValue<'a>>(&self, index: usize) -> Option<V> {
         V::get_at(self, index)
     }
 
@@ -129,39 +153,139 @@ impl Element {
     }
 
     /// Get an element value
-    pub fn element_value<V: GetValue>(&self, element: &str) -> Option<V> {
+    pub fn element_value<V: GetValue<'a>>(&self, element: &str) -> Option<V> {
         self.get_element(element)?.value()
     }
 
+    /// Get a named element value
+    pub fn named_element_value<V: GetValue<'a>>(&self, element: &Name) -> Option<V> {
+        self.get_named_element(element)?.value()
+    }
+
+    /// Get string value at index, borrowed from the element owner without any copy
+    pub fn get_cstr_at(&self, index: usize) -> Option<&'a CStr> {
+        unsafe {
+            let mut tmp: *const std::os::raw::c_char = ptr::null();
+            let res = blpapi_Element_getValueAsString(self.ptr, &mut tmp as *mut _, index);
+            if res == 0 && !tmp.is_null() {
+                Some(CStr::from_ptr(tmp))
+            } else {
+                None
+            }
+        }
+    }
+
+    /// Get string value at index, borrowed from the element owner without any copy
+    ///
+    /// `None` if the value is not valid utf8, see `get_cstr_at`
+    ///
+    /// # Example
+    ///
+    /// The value outlives the `Element` handle, but not its event:
+    ///
+    /// ```
+    /// use blpapi::event::Event;
+    ///
+    /// fn first(event: &Event) -> Option<&str> {
+    ///     let element = event.messages().next()?.element();
+    ///     element.get_str_at(0)
+    /// }
+    /// ```
+    ///
+    /// ```compile_fail
+    /// use blpapi::event::Event;
+    ///
+    /// fn first(event: Event) -> Option<String> {
+    ///     let value = event.messages().next()?.element().get_str_at(0);
+    ///     drop(event);
+    ///     value.map(str::to_owned)
+    /// }
+    /// ```
+    pub fn get_str_at(&self, index: usize) -> Option<&'a str> {
+        self.get_cstr_at(index)?.to_str().ok()
+    }
+
     /// Get current element value (index at 0)
-    pub fn value<V: GetValue>(&self) -> Option<V> {
+    pub fn value<V: GetValue<'a>>(&self) -> Option<V> {
         self.get_at(0)
     }
 
     /// Get an iterator over the values
-    pub fn values<V: GetValue>(&self) -> Values<V> {
+    pub fn values<V: GetValue<'a>>(&self) -> Values<'a, V> {
         Values {
             len: self.num_values(),
-            element: self,
+            element: *self,
             i: 0,
             _phantom: PhantomData,
         }
     }
 
     /// Get an iterator over the elements
-    pub fn elements(&self) -> Elements {
+    pub fn elements(&self) -> Elements<'a> {
         Elements {
             len: self.num_elements(),
-            element: self,
+            element: *self,
             i: 0,
         }
     }
 }
 
+/// An element data type
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+pub enum DataType {
+    Bool,
+    Char,
+    Byte,
+    Int32,
+    Int64,
+    Float32,
+    Float64,
+    String,
+    ByteArray,
+    Date,
+    Time,
+    Decimal,
+    Datetime,
+    Enumeration,
+    Sequence,
+    Choice,
+    CorrelationId,
+    Unknown = -1,
+}
+
+// bindgen constants are lowercase
+#[allow(non_upper_case_globals)]
+impl From<c_int> for DataType {
+    fn from(v: c_int) -> Self {
+        match v {
+            blpapi_DataType_t_BLPAPI_DATATYPE_BOOL => DataType::Bool,
+            blpapi_DataType_t_BLPAPI_DATATYPE_CHAR => DataType::Char,
+            blpapi_DataType_t_BLPAPI_DATATYPE_BYTE => DataType::Byte,
+            blpapi_DataType_t_BLPAPI_DATATYPE_INT32 => DataType::Int32,
+            blpapi_DataType_t_BLPAPI_DATATYPE_INT64 => DataType::Int64,
+            blpapi_DataType_t_BLPAPI_DATATYPE_FLOAT32 => DataType::Float32,
+            blpapi_DataType_t_BLPAPI_DATATYPE_FLOAT64 => DataType::Float64,
+            blpapi_DataType_t_BLPAPI_DATATYPE_STRING => DataType::String,
+            blpapi_DataType_t_BLPAPI_DATATYPE_BYTEARRAY => DataType::ByteArray,
+            blpapi_DataType_t_BLPAPI_DATATYPE_DATE => DataType::Date,
+            blpapi_DataType_t_BLPAPI_DATATYPE_TIME => DataType::Time,
+            blpapi_DataType_t_BLPAPI_DATATYPE_DECIMAL => DataType::Decimal,
+            blpapi_DataType_t_BLPAPI_DATATYPE_DATETIME => DataType::Datetime,
+            blpapi_DataType_t_BLPAPI_DATATYPE_ENUMERATION => DataType::Enumeration,
+            blpapi_DataType_t_BLPAPI_DATATYPE_SEQUENCE => DataType::Sequence,
+            blpapi_DataType_t_BLPAPI_DATATYPE_CHOICE => DataType::Choice,
+            blpapi_DataType_t_BLPAPI_DATATYPE_CORRELATION_ID => DataType::CorrelationId,
+            _ => DataType::Unknown,
+        }
+    }
+}
+
 /// A trait to represent an Element value
-pub trait GetValue: Sized {
+///
+/// `'a` is the lifetime of the element owner, for values borrowing from it.
+pub trait GetValue<'a>: Sized {
     /// Get value from elements by index
-    fn get_at(element: &Element, index: usize) -> Option<Self>;
+    fn get_at(element: &Element<'a>, index: usize) -> Option<Self>;
 }
 
 /// A trait to represent an Element value
@@ -182,8 +306,8 @@ pub trait SetValue: Sized {
 
 macro_rules! impl_value {
     ($ty:ty, $start:expr, $get_at:path, $set_at:path, $set:path) => {
-        impl GetValue for $ty {
-            fn get_at(element: &Element, index: usize) -> Option<Self> {
+        impl<'a> GetValue<'a> for $ty {
+            fn get_at(element: &Element<'a>, index: usize) -> Option<Self> {
                 unsafe {
                     let mut tmp = $start;
                     let res = $get_at(element.ptr, &mut tmp as *mut _, index);
@@ -203,12 +327,11 @@ macro_rules! impl_value {
                 }
             }
             fn set(self, element: &mut Element, name: &str) -> Result<(), Error> {
-                unsafe {
-                    let named_element = ptr::null();
-                    let name = CString::new(name).unwrap();
-                    let res = $set(element.ptr, name.as_ptr(), named_element, self);
+                let named_element = ptr::null();
+                name::with_c_str(name, |name| unsafe {
+                    let res = $set(element.ptr, name, named_element, self);
                     Error::check(res)
-                }
+                })
             }
             fn set_named(self, element: &mut Element, named_element: &Name) -> Result<(), Error> {
                 unsafe {
@@ -220,8 +343,8 @@ macro_rules! impl_value {
         }
     };
     ($ty:ty, $get_at:path, $set_at:path, $set:path, $from_bbg: expr, $to_bbg: expr) => {
-        impl GetValue for $ty {
-            fn get_at(element: &Element, index: usize) -> Option<Self> {
+        impl<'a> GetValue<'a> for $ty {
+            fn get_at(element: &Element<'a>, index: usize) -> Option<Self> {
                 unsafe {
                     let tmp = ptr::null_mut();
                     let res = $get_at(element.ptr, tmp, index);
@@ -241,12 +364,11 @@ macro_rules! impl_value {
                 }
             }
             fn set(self, element: &mut Element, name: &str) -> Result<(), Error> {
-                unsafe {
-                    let named_element = ptr::null();
-                    let name = CString::new(name).unwrap();
-                    let res = $set(element.ptr, name.as_ptr(), named_element, $to_bbg(self));
+                let named_element = ptr::null();
+                name::with_c_str(name, |name| unsafe {
+                    let res = $set(element.ptr, name, named_element, $to_bbg(self));
                     Error::check(res)
-                }
+                })
             }
             fn set_named(self, element: &mut Element, named_element: &Name) -> Result<(), Error> {
                 unsafe {
@@ -311,55 +433,41 @@ impl_value!(
     |rust: Name| rust.0
 );
 
-impl GetValue for String {
-    fn get_at(element: &Element, index: usize) -> Option<Self> {
-        unsafe {
-            let mut tmp = ptr::null();
-            let res = blpapi_Element_getValueAsString(element.ptr, &mut tmp as *mut _, index);
-            if res == 0 {
-                Some(CStr::from_ptr(tmp).to_string_lossy().into_owned())
-            } else {
-                None
-            }
-        }
+impl<'a> GetValue<'a> for String {
+    fn get_at(element: &Element<'a>, index: usize) -> Option<Self> {
+        element
+            .get_cstr_at(index)
+            .map(|s| s.to_string_lossy().into_owned())
     }
 }
 
 impl<'a> SetValue for &'a str {
     fn set_at(self, element: &mut Element, index: usize) -> Result<(), Error> {
-        let value = CString::new(self).unwrap();
-        unsafe {
-            let res = blpapi_Element_setValueString(element.ptr, value.as_ptr(), index);
+        name::with_c_str(self, |value| unsafe {
+            let res = blpapi_Element_setValueString(element.ptr, value, index);
             Error::check(res)
-        }
+        })
     }
     fn set(self, element: &mut Element, name: &str) -> Result<(), Error> {
-        let value = CString::new(self).unwrap();
-        unsafe {
-            let named_element = ptr::null();
-            let name = CString::new(name).unwrap();
-            let res = blpapi_Element_setElementString(
-                element.ptr,
-                name.as_ptr(),
-                named_element,
-                value.as_ptr(),
-            );
-            Error::check(res)
-        }
+        let named_element = ptr::null();
+        name::with_c_str(self, |value| {
+            name::with_c_str(name, |name| unsafe {
+                let res = blpapi_Element_setElementString(element.ptr, name, named_element, value);
+                Error::check(res)
+            })
+        })
     }
     fn set_named(self, element: &mut Element, named_element: &Name) -> Result<(), Error> {
-        let value = CString::new(self).unwrap();
-        unsafe {
+        name::with_c_str(self, |value| unsafe {
             let name = ptr::null();
-            let res =
-                blpapi_Element_setElementString(element.ptr, name, named_element.0, value.as_ptr());
+            let res = blpapi_Element_setElementString(element.ptr, name, named_element.0, value);
             Error::check(res)
-        }
+        })
     }
 }
 
-impl GetValue for Datetime {
-    fn get_at(element: &Element, index: usize) -> Option<Self> {
+impl<'a> GetValue<'a> for Datetime {
+    fn get_at(element: &Element<'a>, index: usize) -> Option<Self> {
         unsafe {
             let mut tmp = Datetime::default();
             let res = blpapi_Element_getValueAsDatetime(element.ptr, &mut tmp.0, index);
@@ -372,25 +480,40 @@ impl GetValue for Datetime {
     }
 }
 
-impl<T: GetValue> GetValue for Option<T> {
-    fn get_at(element: &Element, index: usize) -> Option<Self> {
+impl<'a> GetValue<'a> for HighPrecisionDatetime {
+    fn get_at(element: &Element<'a>, index: usize) -> Option<Self> {
+        unsafe {
+            let mut tmp = HighPrecisionDatetime::default();
+            let res =
+                blpapi_Element_getValueAsHighPrecisionDatetime(element.ptr, &mut tmp.0, index);
+            if res == 0 {
+                Some(tmp)
+            } else {
+                None
+            }
+        }
+    }
+}
+
+impl<'a, T: GetValue<'a>> GetValue<'a> for Option<T> {
+    fn get_at(element: &Element<'a>, index: usize) -> Option<Self> {
         T::get_at(element, index).map(Some)
     }
 }
 
-impl<T: GetValue> GetValue for Vec<T> {
-    fn get_at(element: &Element, index: usize) -> Option<Self> {
+impl<'a, T: GetValue<'a>> GetValue<'a> for Vec<T> {
+    fn get_at(element: &Element<'a>, index: usize) -> Option<Self> {
         Some(element.values().skip(index).collect())
     }
 }
 
-impl GetValue for Element {
-    fn get_at(element: &Element, index: usize) -> Option<Self> {
+impl<'a> GetValue<'a> for Element<'a> {
+    fn get_at(element: &Element<'a>, index: usize) -> Option<Self> {
         unsafe {
             let mut ptr = ptr::null_mut();
             let res = blpapi_Element_getValueAsElement(element.ptr, &mut ptr as *mut _, index);
             if res == 0 {
-                Some(Element { ptr })
+                Some(Element::new(ptr))
             } else {
                 None
             }
@@ -398,8 +521,8 @@ impl GetValue for Element {
     }
 }
 
-impl<T: GetValue + std::hash::Hash + Eq> GetValue for std::collections::HashSet<T> {
-    fn get_at(element: &Element, index: usize) -> Option<Self> {
+impl<'a, T: GetValue<'a> + std::hash::Hash + Eq> GetValue<'a> for std::collections::HashSet<T> {
+    fn get_at(element: &Element<'a>, index: usize) -> Option<Self> {
         Some(element.values().skip(index).collect())
     }
 }
@@ -412,17 +535,11 @@ impl<'a> SetValue for &'a Datetime {
         }
     }
     fn set(self, element: &mut Element, name: &str) -> Result<(), Error> {
-        unsafe {
-            let named_element = ptr::null();
-            let name = CString::new(name).unwrap();
-            let res = blpapi_Element_setElementDatetime(
-                element.ptr,
-                name.as_ptr(),
-                named_element,
-                &self.0 as *const _,
-            );
+        let named_element = ptr::null();
+        name::with_c_str(name, |name| unsafe {
+            let res = blpapi_Element_setElementDatetime(element.ptr, name, named_element, &self.0);
             Error::check(res)
-        }
+        })
     }
     fn set_named(self, element: &mut Element, named_element: &Name) -> Result<(), Error> {
         unsafe {
@@ -440,13 +557,13 @@ impl<'a> SetValue for &'a Datetime {
 
 /// An iterator over values
 pub struct Values<'a, V> {
-    element: &'a Element,
+    element: Element<'a>,
     i: usize,
     len: usize,
     _phantom: PhantomData<V>,
 }
 
-impl<'a, V: GetValue> Iterator for Values<'a, V> {
+impl<'a, V: GetValue<'a>> Iterator for Values<'a, V> {
     type Item = V;
     fn size_hint(&self) -> (usize, Option<usize>) {
         (self.len - self.i, Some(self.len - self.i))
@@ -461,9 +578,28 @@ impl<'a, V: GetValue> Iterator for Values<'a, V> {
     }
 }
 
+/// Converted straight from the high precision value, in its own time zone
+#[cfg(feature = "dates")]
+impl<'a> GetValue<'a> for chrono::NaiveDateTime {
+    fn get_at(element: &Element<'a>, index: usize) -> Option<Self> {
+        element
+            .get_at(index)
+            .and_then(|d: HighPrecisionDatetime| d.to_naive_datetime())
+    }
+}
+
+#[cfg(feature = "dates")]
+impl<'a> GetValue<'a> for chrono::DateTime<chrono::Utc> {
+    fn get_at(element: &Element<'a>, index: usize) -> Option<Self> {
+        element
+            .get_at(index)
+            .and_then(|d: HighPrecisionDatetime| d.to_utc())
+    }
+}
+
 #[cfg(feature = "dates")]
-impl GetValue for chrono::NaiveDate {
-    fn get_at(element: &Element, index: usize) -> Option<Self> {
+impl<'a> GetValue<'a> for chrono::NaiveDate {
+    fn get_at(element: &Element<'a>, index: usize) -> Option<Self> {
         element.get_at(index).map(|d: Datetime| {
             chrono::NaiveDate::from_ymd(d.0.year as i32, d.0.month as u32, d.0.day as u32)
         })
@@ -472,17 +608,17 @@ impl GetValue for chrono::NaiveDate {
 
 /// An iterator over elements
 pub struct Elements<'a> {
-    element: &'a Element,
+    element: Element<'a>,
     i: usize,
     len: usize,
 }
 
 impl<'a> Iterator for Elements<'a> {
-    type Item = Element;
+    type Item = Element<'a>;
     fn size_hint(&self) -> (usize, Option<usize>) {
         (self.len - self.i, Some(self.len - self.i))
     }
-    fn next(&mut self) -> Option<Element> {
+    fn next(&mut self) -> Option<Element<'a>> {
         if self.i == self.len {
             return None;
         }
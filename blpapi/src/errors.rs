@@ -1,4 +1,4 @@
-use crate::element::Element;
+use crate::{name, session::Tree};
 
 /// Error converted from `c_int`
 #[derive(Debug)]
@@ -22,8 +22,28 @@ pub enum Error {
         sub_category: Option<String>,
         message: String,
     },
+    /// A whole request failed (`RequestFailure`, `responseError`)
+    Request {
+        category: String,
+        message: String,
+    },
+    /// The session terminated before the end of the request
+    SessionTerminated,
+    /// A request of a batch of securities failed as a whole
+    Batch {
+        securities: Vec<String>,
+        error: Box<Error>,
+    },
     /// Timeout event
     TimeOut,
+    /// Local storage error (e.g. cache file)
+    Io(std::io::Error),
+}
+
+impl From<std::io::Error> for Error {
+    fn from(e: std::io::Error) -> Self {
+        Error::Io(e)
+    }
 }
 
 impl std::fmt::Display for Error {
@@ -34,7 +54,11 @@ impl std::fmt::Display for Error {
 
 impl std::error::Error for Error {
     fn source(&self) -> Option<&(dyn std::error::Error + 'static)> {
-        None
+        match self {
+            Error::Io(e) => Some(e),
+            Error::Batch { error, .. } => Some(&**error),
+            _ => None,
+        }
     }
 }
 
@@ -62,15 +86,13 @@ impl Error {
     }
 
     /// Create a security error
-    pub(crate) fn security(security: String, element: Element) -> Error {
+    pub(crate) fn security<T: Tree>(security: String, element: T) -> Error {
         let category = element
-            .get_element("category")
-            .and_then(|e| e.get_at(0))
+            .child_string(&name::CATEGORY)
             .unwrap_or_else(String::new);
-        let sub_category = element.get_element("subcategory").and_then(|e| e.get_at(0));
+        let sub_category = element.child_string(&name::SUBCATEGORY);
         let message = element
-            .get_element("message")
-            .and_then(|e| e.get_at(0))
+            .child_string(&name::MESSAGE)
             .unwrap_or_else(String::new);
         Error::Security {
             security,
@@ -79,4 +101,17 @@ impl Error {
             message,
         }
     }
+
+    /// Create a request error from a `RequestFailure` reason or a `responseError`
+    #[cfg(feature = "async")]
+    pub(crate) fn request<T: Tree>(element: T) -> Error {
+        let category = element
+            .child_string(&name::CATEGORY)
+            .unwrap_or_else(String::new);
+        let message = element
+            .child_string(&name::MESSAGE)
+            .or_else(|| element.child_string(&name::DESCRIPTION))
+            .unwrap_or_else(String::new);
+        Error::Request { category, message }
+    }
 }
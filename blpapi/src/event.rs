@@ -5,6 +5,10 @@ use std::os::raw::c_int;
 /// An event
 pub struct Event(pub(crate) *mut blpapi_Event_t);
 
+// Events are immutable once delivered by the session so they can be
+// handed over to another thread
+unsafe impl Send for Event {}
+
 impl Event {
     /// Get event type
     pub fn event_type(&self) -> EventType {
@@ -12,11 +16,28 @@ impl Event {
     }
 
     /// Get an iterator over all messages of this event
+    ///
+    /// Messages are borrowed from the event, see `Message::to_owned` to keep
+    /// them longer.
     pub fn messages(&self) -> MessageIterator {
         MessageIterator::new(self)
     }
 }
 
+impl Clone for Event {
+    /// Get a new reference to the same event
+    fn clone(&self) -> Self {
+        unsafe { blpapi_Event_addRef(self.0) };
+        Event(self.0)
+    }
+}
+
+impl Drop for Event {
+    fn drop(&mut self) {
+        unsafe { blpapi_Event_release(self.0) };
+    }
+}
+
 #[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
 pub enum EventType {
     Admin,
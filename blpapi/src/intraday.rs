@@ -0,0 +1,349 @@
+//! Intraday bars and ticks
+//!
+//! `IntradayBarRequest` and `IntradayTickRequest` are sent for a single
+//! security. Their (possibly very large) responses are streamed, see
+//! `SessionSync::intraday_bars` and `SessionSync::intraday_ticks`.
+//!
+//! Long periods can be split into several requests of at most a given
+//! `window`, sent one after the other, so that a slow consumer never lets
+//! more than one window of data pile up in the session event queue.
+//! Consecutive windows share their boundary: values timestamped exactly at a
+//! boundary, returned by both requests, are only kept from the later one.
+
+use crate::{
+    datetime::Datetime,
+    element::Element,
+    event::Event,
+    name::{self, Name},
+    request::Request,
+    Error,
+};
+use std::collections::VecDeque;
+use std::time::Duration;
+
+/// An intraday bar
+#[derive(Debug, Default, Clone)]
+pub struct Bar {
+    /// Bar start time
+    pub time: Datetime,
+    pub open: f64,
+    pub high: f64,
+    pub low: f64,
+    pub close: f64,
+    pub volume: i64,
+    pub num_events: i64,
+    pub value: f64,
+}
+
+impl Bar {
+    fn from_element(element: &Element) -> Self {
+        Bar {
+            time: element.named_element_value(&name::TIME).unwrap_or_default(),
+            open: element.named_element_value(&name::OPEN).unwrap_or_default(),
+            high: element.named_element_value(&name::HIGH).unwrap_or_default(),
+            low: element.named_element_value(&name::LOW).unwrap_or_default(),
+            close: element
+                .named_element_value(&name::CLOSE)
+                .unwrap_or_default(),
+            volume: element
+                .named_element_value(&name::VOLUME)
+                .unwrap_or_default(),
+            num_events: element
+                .named_element_value(&name::NUM_EVENTS)
+                .unwrap_or_default(),
+            value: element
+                .named_element_value(&name::VALUE)
+                .unwrap_or_default(),
+        }
+    }
+}
+
+/// An intraday tick
+#[derive(Debug, Clone)]
+pub struct Tick {
+    pub time: Datetime,
+    /// Event type (TRADE, BID, ASK ...)
+    pub event_type: Name,
+    pub value: f64,
+    pub size: i64,
+    /// Condition codes, if requested
+    pub condition_codes: Option<String>,
+}
+
+impl Tick {
+    fn from_element(element: &Element) -> Self {
+        Tick {
+            time: element.named_element_value(&name::TIME).unwrap_or_default(),
+            event_type: element
+                .named_element_value(&name::TYPE)
+                .unwrap_or_else(|| Name::new("")),
+            value: element
+                .named_element_value(&name::VALUE)
+                .unwrap_or_default(),
+            size: element.named_element_value(&name::SIZE).unwrap_or_default(),
+            condition_codes: element.named_element_value(&name::CONDITION_CODES),
+        }
+    }
+}
+
+/// Options for intraday bar requests
+#[derive(Debug, Clone)]
+pub struct BarOptions {
+    start: Datetime,
+    end: Datetime,
+    /// Bar length, in minutes
+    interval: i32,
+    /// TRADE, BID, ASK ...
+    event_type: String,
+    /// Maximum period of a single request
+    window: Option<Duration>,
+}
+
+impl BarOptions {
+    /// Create new options for `interval` minutes TRADE bars between `start` and
+    /// `end` (UTC)
+    pub fn new(start: Datetime, end: Datetime, interval: i32) -> Self {
+        BarOptions {
+            start,
+            end,
+            interval,
+            event_type: "TRADE".into(),
+            window: None,
+        }
+    }
+
+    /// Set event type (TRADE, BID, ASK ...)
+    pub fn with_event_type(mut self, event_type: &str) -> Self {
+        self.event_type = event_type.into();
+        self
+    }
+
+    /// Split the period into requests of at most `window`
+    pub fn with_window(mut self, window: Duration) -> Self {
+        self.window = Some(window);
+        self
+    }
+
+    pub(crate) fn windows(&self) -> Vec<Window> {
+        windows(self.start, self.end, self.window)
+    }
+
+    pub(crate) fn apply(
+        &self,
+        request: &mut Request,
+        security: &str,
+        window: &Window,
+    ) -> Result<(), Error> {
+        let mut element = request.element();
+        element.set_named(&name::SECURITY_NAME, security)?;
+        element.set_named(&name::EVENT_TYPE, &self.event_type[..])?;
+        element.set_named(&name::INTERVAL, self.interval)?;
+        element.set_named(&name::START_DATE_TIME, &window.start)?;
+        element.set_named(&name::END_DATE_TIME, &window.end)?;
+        Ok(())
+    }
+}
+
+/// Options for intraday tick requests
+#[derive(Debug, Clone)]
+pub struct TickOptions {
+    start: Datetime,
+    end: Datetime,
+    /// TRADE, BID, ASK ..., TRADE if empty
+    event_types: Vec<String>,
+    condition_codes: bool,
+    /// Maximum period of a single request
+    window: Option<Duration>,
+}
+
+impl TickOptions {
+    /// Create new options for TRADE ticks between `start` and `end` (UTC)
+    pub fn new(start: Datetime, end: Datetime) -> Self {
+        TickOptions {
+            start,
+            end,
+            event_types: Vec::new(),
+            condition_codes: false,
+            window: None,
+        }
+    }
+
+    /// Add an event type (TRADE, BID, ASK ...)
+    pub fn with_event_type(mut self, event_type: &str) -> Self {
+        self.event_types.push(event_type.into());
+        self
+    }
+
+    /// Include condition codes
+    pub fn with_condition_codes(mut self) -> Self {
+        self.condition_codes = true;
+        self
+    }
+
+    /// Split the period into requests of at most `window`
+    pub fn with_window(mut self, window: Duration) -> Self {
+        self.window = Some(window);
+        self
+    }
+
+    pub(crate) fn windows(&self) -> Vec<Window> {
+        windows(self.start, self.end, self.window)
+    }
+
+    pub(crate) fn apply(
+        &self,
+        request: &mut Request,
+        security: &str,
+        window: &Window,
+    ) -> Result<(), Error> {
+        if self.event_types.is_empty() {
+            request.append_named(&name::EVENT_TYPES, "TRADE")?;
+        }
+        for event_type in &self.event_types {
+            request.append_named(&name::EVENT_TYPES, &event_type[..])?;
+        }
+        let mut element = request.element();
+        element.set_named(&name::SECURITY_NAME, security)?;
+        if self.condition_codes {
+            element.set_named(&name::INCLUDE_CONDITION_CODES, true)?;
+        }
+        element.set_named(&name::START_DATE_TIME, &window.start)?;
+        element.set_named(&name::END_DATE_TIME, &window.end)?;
+        Ok(())
+    }
+}
+
+/// The period of a single intraday request
+#[derive(Debug, Clone, Copy)]
+pub(crate) struct Window {
+    pub start: Datetime,
+    pub end: Datetime,
+    /// Values at or after this time (nanoseconds since 1970-01-01) are
+    /// dropped, they are returned by the next window too
+    pub until: Option<i64>,
+}
+
+/// Split `start..end` into consecutive windows of at most `window`
+fn windows(start: Datetime, end: Datetime, window: Option<Duration>) -> Vec<Window> {
+    let seconds = |d: Datetime| d.epoch_nanos().map(|n| n.div_euclid(1_000_000_000));
+    let (first, last, window) = match (seconds(start), seconds(end), window) {
+        (Some(first), Some(last), Some(window)) if window.as_secs() > 0 => {
+            (first, last, window.as_secs() as i64)
+        }
+        _ => {
+            return vec![Window {
+                start,
+                end,
+                until: None,
+            }]
+        }
+    };
+    let mut windows = Vec::new();
+    let mut from = first;
+    loop {
+        let to = (from + window).min(last);
+        let until = if to < last {
+            Some(to * 1_000_000_000)
+        } else {
+            None
+        };
+        windows.push(Window {
+            start: Datetime::from_epoch_seconds(from),
+            end: Datetime::from_epoch_seconds(to),
+            until,
+        });
+        if to >= last {
+            return windows;
+        }
+        from = to;
+    }
+}
+
+/// Is `time` before the end of the window (if any)
+fn before(time: &Datetime, until: Option<i64>) -> bool {
+    match (time.epoch_nanos(), until) {
+        (Some(time), Some(until)) => time < until,
+        _ => true,
+    }
+}
+
+/// Decode an `IntradayBarRequest` response event, one item per bar
+pub(crate) fn bars_event(
+    event: &Event,
+    security: &str,
+    until: Option<i64>,
+    items: &mut VecDeque<Result<Bar, Error>>,
+) {
+    for message in event.messages().map(|m| m.element()) {
+        if let Some(error) = message.get_named_element(&name::RESPONSE_ERROR) {
+            items.push_back(Err(Error::security(security.to_owned(), error)));
+            continue;
+        }
+        let bars = message
+            .get_named_element(&name::BAR_DATA)
+            .and_then(|data| data.get_named_element(&name::BAR_TICK_DATA));
+        if let Some(bars) = bars {
+            items.extend(
+                bars.values::<Element>()
+                    .map(|bar| Bar::from_element(&bar))
+                    .filter(|bar| before(&bar.time, until))
+                    .map(Ok),
+            );
+        }
+    }
+}
+
+/// Decode an `IntradayTickRequest` response event, one item per tick
+pub(crate) fn ticks_event(
+    event: &Event,
+    security: &str,
+    until: Option<i64>,
+    items: &mut VecDeque<Result<Tick, Error>>,
+) {
+    for message in event.messages().map(|m| m.element()) {
+        if let Some(error) = message.get_named_element(&name::RESPONSE_ERROR) {
+            items.push_back(Err(Error::security(security.to_owned(), error)));
+            continue;
+        }
+        let ticks = message
+            .get_named_element(&name::TICK_DATA)
+            .and_then(|data| data.get_named_element(&name::TICK_DATA));
+        if let Some(ticks) = ticks {
+            items.extend(
+                ticks
+                    .values::<Element>()
+                    .map(|tick| Tick::from_element(&tick))
+                    .filter(|tick| before(&tick.time, until))
+                    .map(Ok),
+            );
+        }
+    }
+}
+
+#[test]
+fn split_windows() {
+    let start = Datetime::from_ymd_hms(2019, 12, 2, 14, 30, 0);
+    let end = Datetime::from_ymd_hms(2019, 12, 4, 21, 0, 0);
+    assert_eq!(windows(start, end, None).len(), 1);
+
+    let day = Duration::from_secs(86_400);
+    let windows = windows(start, end, Some(day));
+    let periods = windows
+        .iter()
+        .map(|w| format!("{:?}/{:?}", w.start, w.end))
+        .collect::<Vec<_>>();
+    assert_eq!(
+        periods,
+        vec![
+            "2019-12-02 14:30:00.000/2019-12-03 14:30:00.000",
+            "2019-12-03 14:30:00.000/2019-12-04 14:30:00.000",
+            "2019-12-04 14:30:00.000/2019-12-04 21:00:00.000",
+        ]
+    );
+
+    // boundary values are only kept by the later window
+    let boundary = windows[1].start;
+    assert!(!before(&boundary, windows[0].until));
+    assert!(before(&boundary, windows[1].until));
+    assert!(before(&end, windows[2].until));
+}
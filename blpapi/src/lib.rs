@@ -1,19 +1,38 @@
+pub mod cache;
+pub mod columnar;
 pub mod correlation_id;
 pub mod datetime;
 pub mod element;
 pub mod errors;
 pub mod event;
+pub mod intraday;
 pub mod message;
 pub mod message_iterator;
 pub mod name;
 pub mod ref_data;
+pub mod replay;
 pub mod request;
+#[cfg(feature = "async")]
+mod ring;
+#[cfg(feature = "async")]
+pub mod scheduler;
 pub mod service;
 pub mod session;
+#[cfg(feature = "async")]
+pub mod session_async;
 pub mod session_options;
+pub mod stream;
+#[cfg(feature = "async")]
+pub mod subscription;
+pub mod subscription_list;
+pub mod value;
 
 #[cfg(feature = "derive")]
 pub use blpapi_derive::*;
 pub use errors::Error;
+#[doc(hidden)]
+pub use lazy_static;
 pub use ref_data::RefData;
 pub use session::SessionSync;
+#[cfg(feature = "async")]
+pub use session_async::SessionAsync;
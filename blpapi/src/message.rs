@@ -42,7 +42,7 @@ impl<'a> Message<'a> {
 
     /// Get correlation id
     pub fn correlation_id(&self, index: usize) -> Option<CorrelationId> {
-        if index > self.num_correlation_ids() {
+        if index >= self.num_correlation_ids() {
             None
         } else {
             unsafe {
@@ -52,22 +52,54 @@ impl<'a> Message<'a> {
         }
     }
 
-    /// Get corresponding element
-    pub fn element(&self) -> Element {
-        Element { ptr: self.elements }
+    /// Get corresponding element, valid as long as the event
+    pub fn element(&self) -> Element<'a> {
+        unsafe { Element::new(self.elements) }
+    }
+
+    /// Take a new reference on this message, which can outlive its event
+    pub fn to_owned(&self) -> OwnedMessage {
+        unsafe {
+            blpapi_Message_addRef(self.ptr);
+        }
+        OwnedMessage(Message {
+            ptr: self.ptr,
+            _phantom: PhantomData,
+            elements: self.elements,
+        })
     }
 }
 
-//TODO:
-//check if we must release it.
-//from the doc, it appears that messages are reference counted (when cloned) and
-//release just decrease the refcount ...
-//
-//impl<'a> Drop for Message<'a> {
-//    fn drop(&mut self) {
-//        unsafe { let _ = blpapi_Message_release(self.ptr); }
-//    }
-//}
+/// A message, kept alive independently of its `Event`
+///
+/// Created with `Message::to_owned`, it holds a reference on the message
+/// which is released on drop. Its elements borrow from it, see `message`.
+pub struct OwnedMessage(Message<'static>);
+
+// The message is reference counted and immutable, thus it can be sent to
+// another thread
+unsafe impl Send for OwnedMessage {}
+
+impl OwnedMessage {
+    /// Get the message, borrowed from this reference
+    pub fn message(&self) -> &Message<'_> {
+        &self.0
+    }
+}
+
+impl Clone for OwnedMessage {
+    fn clone(&self) -> Self {
+        self.0.to_owned()
+    }
+}
+
+impl Drop for OwnedMessage {
+    fn drop(&mut self) {
+        unsafe {
+            let _ = blpapi_Message_release(self.0.ptr);
+        }
+    }
+}
 
 //pub enum RecapType {
 //    None = BLPAPI_MESSAGE_RECAPTYPE_NONE,
@@ -1,5 +1,6 @@
 use blpapi_sys::*;
 use std::ffi::{CStr, CString};
+use std::os::raw::c_char;
 
 lazy_static::lazy_static! {
     pub static ref SECURITY_DATA: Name = Name::new("securityData");
@@ -8,8 +9,69 @@ lazy_static::lazy_static! {
     pub static ref SECURITY_ERROR: Name = Name::new("securityError");
     pub static ref SECURITIES: Name = Name::new("securities");
     pub static ref FIELDS_NAME: Name = Name::new("fields");
-    pub static ref SESSION_TERMINATED: Name = Name::new("SesssionTerminated");
+    pub static ref DATE: Name = Name::new("date");
+    pub static ref SESSION_TERMINATED: Name = Name::new("SessionTerminated");
     pub static ref SESSION_STARTUP_FAILURE: Name = Name::new("SessionStartupFailure");
+    pub static ref REQUEST_FAILURE: Name = Name::new("RequestFailure");
+    pub static ref SUBSCRIPTION_FAILURE: Name = Name::new("SubscriptionFailure");
+    pub static ref SUBSCRIPTION_TERMINATED: Name = Name::new("SubscriptionTerminated");
+    pub static ref REASON: Name = Name::new("reason");
+    pub static ref DESCRIPTION: Name = Name::new("description");
+    pub static ref START_DATE: Name = Name::new("startDate");
+    pub static ref END_DATE: Name = Name::new("endDate");
+    pub static ref PERIODICITY_SELECTION: Name = Name::new("periodicitySelection");
+    pub static ref PERIODICITY_ADJUSTMENT: Name = Name::new("periodicityAdjustment");
+    pub static ref MAX_DATA_POINTS: Name = Name::new("maxDataPoints");
+    pub static ref CURRENCY: Name = Name::new("currency");
+    pub static ref CATEGORY: Name = Name::new("category");
+    pub static ref SUBCATEGORY: Name = Name::new("subcategory");
+    pub static ref MESSAGE: Name = Name::new("message");
+    pub static ref RESPONSE_ERROR: Name = Name::new("responseError");
+    pub static ref START_DATE_TIME: Name = Name::new("startDateTime");
+    pub static ref END_DATE_TIME: Name = Name::new("endDateTime");
+    pub static ref EVENT_TYPE: Name = Name::new("eventType");
+    pub static ref EVENT_TYPES: Name = Name::new("eventTypes");
+    pub static ref INTERVAL: Name = Name::new("interval");
+    pub static ref INCLUDE_CONDITION_CODES: Name = Name::new("includeConditionCodes");
+    pub static ref BAR_DATA: Name = Name::new("barData");
+    pub static ref BAR_TICK_DATA: Name = Name::new("barTickData");
+    pub static ref TICK_DATA: Name = Name::new("tickData");
+    pub static ref TIME: Name = Name::new("time");
+    pub static ref OPEN: Name = Name::new("open");
+    pub static ref HIGH: Name = Name::new("high");
+    pub static ref LOW: Name = Name::new("low");
+    pub static ref CLOSE: Name = Name::new("close");
+    pub static ref VOLUME: Name = Name::new("volume");
+    pub static ref NUM_EVENTS: Name = Name::new("numEvents");
+    pub static ref VALUE: Name = Name::new("value");
+    pub static ref TYPE: Name = Name::new("type");
+    pub static ref SIZE: Name = Name::new("size");
+    pub static ref CONDITION_CODES: Name = Name::new("conditionCodes");
+}
+
+/// Longest string converted to a C string on the stack
+const STACK_STR_LEN: usize = 128;
+
+/// Call `f` with a nul terminated copy of `s`
+///
+/// Short strings are copied on the stack, without any allocation.
+///
+/// # Panics
+///
+/// If `s` contains a nul byte
+pub(crate) fn with_c_str<T, F>(s: &str, f: F) -> T
+where
+    F: FnOnce(*const c_char) -> T,
+{
+    let bytes = s.as_bytes();
+    if bytes.len() < STACK_STR_LEN && !bytes.contains(&0) {
+        let mut buf = [0u8; STACK_STR_LEN];
+        buf[..bytes.len()].copy_from_slice(bytes);
+        f(buf.as_ptr() as *const c_char)
+    } else {
+        let s = CString::new(s).unwrap();
+        f(s.as_ptr())
+    }
 }
 
 /// A `Name`
@@ -19,12 +81,12 @@ pub struct Name(pub(crate) *mut blpapi_Name_t);
 // *Each Name instance refers to an entry in a global static table* thus Name is `Sync`
 // https://bloomberg.github.io/blpapi-docs/dotnet/3.12/html/T_Bloomberglp_Blpapi_Name.htm
 unsafe impl Sync for Name {}
+unsafe impl Send for Name {}
 
 impl Name {
     /// Create a new name
     pub fn new(s: &str) -> Self {
-        let name = CString::new(s).unwrap();
-        unsafe { Name(blpapi_Name_create(name.as_ptr())) }
+        with_c_str(s, |name| unsafe { Name(blpapi_Name_create(name)) })
     }
 
     /// Name length
@@ -59,8 +121,7 @@ impl Clone for Name {
 
 impl<S: AsRef<str>> PartialEq<S> for Name {
     fn eq(&self, other: &S) -> bool {
-        let s = CString::new(other.as_ref()).unwrap();
-        unsafe { blpapi_Name_equalsStr(self.0, s.as_ptr()) != 0 }
+        self.to_bytes() == other.as_ref().as_bytes()
     }
 }
 
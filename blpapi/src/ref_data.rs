@@ -1,7 +1,56 @@
-use crate::element::Element;
+use crate::{element::Element, name::Name, value::Value};
 
 /// A trait to convert reference data element fields into a struct
 pub trait RefData: Default {
     const FIELDS: &'static [&'static str];
     fn on_field(&mut self, field: &str, element: &Element);
+
+    /// Same as `on_field`, from the field `Name`
+    ///
+    /// Defaults to `on_field`. The derive implementation dispatches on the
+    /// interned `Name` instead, without any string allocation or comparison.
+    fn on_named_field(&mut self, field: &Name, element: &Element) {
+        self.on_field(&field.to_string_lossy(), element)
+    }
+
+    /// Set a field from an owned `Value`, e.g. a cached one
+    ///
+    /// Returns `false` if the field cannot be set from a `Value`, which is the
+    /// default. The derive implementation supports every field without a
+    /// custom `decode`.
+    fn on_value(&mut self, _field: &str, _value: &Value) -> bool {
+        false
+    }
+}
+
+/// A static table of interned field `Name`s
+///
+/// Bloomberg names are interned, thus the index of a field is found by
+/// `Name` pointer identity. Field lists are short: a linear scan of the
+/// pointers is faster than hashing them.
+pub struct FieldIndex {
+    names: Vec<Name>,
+}
+
+impl FieldIndex {
+    /// Create a new index from a list of fields
+    pub fn new(fields: &[&str]) -> Self {
+        let names = fields.iter().map(|f| Name::new(f)).collect();
+        FieldIndex { names }
+    }
+
+    /// Get the index of a field
+    pub fn get(&self, name: &Name) -> Option<usize> {
+        self.names.iter().position(|n| n.0 == name.0)
+    }
+
+    /// Get all the names
+    pub fn names(&self) -> &[Name] {
+        &self.names
+    }
+}
+
+#[doc(hidden)]
+pub fn unknown_field<F: std::fmt::Debug + ?Sized>(field: &F) {
+    log::debug!("Unrecognized field {:?}", field);
 }
@@ -0,0 +1,395 @@
+//! Event sources, and offline replay of recorded events
+//!
+//! A `SessionSync` can record all the events it receives
+//! (`start_recording`/`stop_recording`). The resulting `Replay` can then be
+//! decoded again, as many times as needed, without any connection, e.g. to
+//! benchmark or test the decoding path.
+//!
+//! Recorded events live in the blpapi library and cannot outlive the
+//! process. A `Recording` copies them into plain element trees, which can be
+//! saved to disk, loaded back, or built by hand, and are decoded by the same
+//! code as live responses without any terminal.
+
+use crate::{
+    columnar::{self, Columns},
+    element::{DataType, Element},
+    event::{Event, EventType},
+    name::Name,
+    ref_data::{FieldIndex, RefData},
+    session::{self, Date, Events, TimeSerie, Tree},
+    value::{encode_str, encode_value, Reader, Value},
+    Error,
+};
+use std::collections::HashMap;
+use std::fs::File;
+use std::io::{BufWriter, Read, Write};
+use std::path::Path;
+
+/// File header, with format version
+const MAGIC: &[u8] = b"BLPREPLAY1\n";
+
+/// A source of events
+pub trait EventSource {
+    /// Get next event, optionally waiting timeout_ms if there is no event
+    fn next_event(&mut self, timeout_ms: Option<u32>) -> Result<Event, Error>;
+}
+
+/// Recorded events, replayed in order
+///
+/// Events are reference counted: replaying them doesn't copy anything.
+#[derive(Clone, Default)]
+pub struct Replay {
+    events: Vec<Event>,
+    position: usize,
+}
+
+impl Replay {
+    /// Create a new replay from recorded events
+    pub fn new(events: Vec<Event>) -> Self {
+        Replay {
+            events,
+            position: 0,
+        }
+    }
+
+    /// Number of recorded events
+    pub fn len(&self) -> usize {
+        self.events.len()
+    }
+
+    /// Is empty
+    pub fn is_empty(&self) -> bool {
+        self.events.is_empty()
+    }
+
+    /// Get recorded events
+    pub fn events(&self) -> &[Event] {
+        &self.events
+    }
+
+    /// Copy all recorded messages into a `Recording`
+    pub fn to_recording(&self) -> Recording {
+        let messages = self
+            .events
+            .iter()
+            .flat_map(|event| event.messages())
+            .map(|message| {
+                let node = Node::from_element(&message.element());
+                (message.type_string(), node)
+            })
+            .collect();
+        Recording { messages }
+    }
+
+    /// Restart replay from the first event
+    pub fn rewind(&mut self) {
+        self.position = 0;
+    }
+
+    /// Position after the last `Response` event
+    ///
+    /// Events recorded after it (e.g. session status) are not part of any
+    /// request and are not decoded.
+    fn responses_end(&self) -> usize {
+        self.events
+            .iter()
+            .rposition(|e| e.event_type() == EventType::Response)
+            .map_or(0, |i| i + 1)
+    }
+
+    /// Decode all the remaining `ReferenceDataRequest` responses
+    pub fn ref_data<R: RefData>(&mut self) -> Result<HashMap<String, R>, Error> {
+        let mut ref_data = HashMap::new();
+        let mut errors = Vec::new();
+        let end = self.responses_end();
+        while self.position < end {
+            for event in Events::new(self) {
+                session::ref_data_event(&event?, &mut ref_data, &mut errors);
+            }
+        }
+        match errors.into_iter().next() {
+            Some(error) => Err(error),
+            None => Ok(ref_data),
+        }
+    }
+
+    /// Decode all the remaining `HistoricalDataRequest` responses
+    pub fn hist_data<R: RefData>(&mut self) -> Result<HashMap<String, TimeSerie<R>>, Error> {
+        let mut ref_data = HashMap::new();
+        let mut errors = Vec::new();
+        let end = self.responses_end();
+        while self.position < end {
+            for event in Events::new(self) {
+                session::hist_data_event(&event?, &mut ref_data, &mut errors);
+            }
+        }
+        match errors.into_iter().next() {
+            Some(error) => Err(error),
+            None => Ok(ref_data),
+        }
+    }
+
+    /// Decode all the remaining `HistoricalDataRequest` responses into columns
+    pub fn hist_data_columnar(
+        &mut self,
+        fields: &[&str],
+    ) -> Result<HashMap<String, Columns>, Error> {
+        let index = FieldIndex::new(fields);
+        let mut columns = HashMap::new();
+        let end = self.responses_end();
+        while self.position < end {
+            for event in Events::new(self) {
+                columnar::hist_data_event(&event?, &index, &mut columns);
+            }
+        }
+        Ok(columns)
+    }
+}
+
+impl EventSource for Replay {
+    /// Get next recorded event, `Error::TimeOut` once all events are replayed
+    fn next_event(&mut self, _timeout_ms: Option<u32>) -> Result<Event, Error> {
+        let event = self.events.get(self.position).ok_or(Error::TimeOut)?;
+        self.position += 1;
+        Ok(event.clone())
+    }
+}
+
+/// A plain copy of an element tree
+#[derive(Debug, Clone)]
+pub enum Node {
+    /// A scalar or an array of scalars
+    Value(Value),
+    /// Named sub elements, of a sequence or a choice
+    Sequence(Vec<(Name, Node)>),
+    /// An array of sequences
+    Array(Vec<Node>),
+}
+
+impl Node {
+    /// Copy an element and all its sub elements
+    pub fn from_element(element: &Element) -> Node {
+        match element.datatype() {
+            DataType::Sequence | DataType::Choice if element.is_array() => Node::Array(
+                element
+                    .values::<Element>()
+                    .map(|e| Node::from_element(&e))
+                    .collect(),
+            ),
+            DataType::Sequence | DataType::Choice => Node::Sequence(
+                element
+                    .elements()
+                    .map(|e| (e.name(), Node::from_element(&e)))
+                    .collect(),
+            ),
+            _ => Node::Value(Value::from_element(element).unwrap_or(Value::Null)),
+        }
+    }
+
+    /// Create a sequence from (name, node) pairs
+    pub fn sequence<'a, I: IntoIterator<Item = (&'a str, Node)>>(elements: I) -> Node {
+        Node::Sequence(
+            elements
+                .into_iter()
+                .map(|(name, node)| (Name::new(name), node))
+                .collect(),
+        )
+    }
+
+    /// Get a sub element by name
+    pub fn get(&self, name: &Name) -> Option<&Node> {
+        match self {
+            Node::Sequence(elements) => elements.iter().find(|(n, _)| n == name).map(|(_, e)| e),
+            _ => None,
+        }
+    }
+
+    /// Sub elements of a sequence, empty otherwise
+    pub fn elements(&self) -> &[(Name, Node)] {
+        match self {
+            Node::Sequence(elements) => elements,
+            _ => &[],
+        }
+    }
+
+    /// Values of an array, the node itself otherwise
+    pub fn values(&self) -> &[Node] {
+        match self {
+            Node::Array(values) => values,
+            node => std::slice::from_ref(node),
+        }
+    }
+
+    fn encode(&self, buf: &mut Vec<u8>) {
+        match self {
+            Node::Value(value) => {
+                buf.push(0);
+                encode_value(buf, value);
+            }
+            Node::Sequence(elements) => {
+                buf.push(1);
+                buf.extend_from_slice(&(elements.len() as u32).to_le_bytes());
+                for (name, element) in elements {
+                    encode_str(buf, &name.to_string_lossy());
+                    element.encode(buf);
+                }
+            }
+            Node::Array(values) => {
+                buf.push(2);
+                buf.extend_from_slice(&(values.len() as u32).to_le_bytes());
+                for value in values {
+                    value.encode(buf);
+                }
+            }
+        }
+    }
+
+    fn decode(reader: &mut Reader) -> Option<Node> {
+        let node = match reader.u8()? {
+            0 => Node::Value(reader.value()?),
+            1 => Node::Sequence(
+                (0..reader.u32()?)
+                    .map(|_| Some((Name::new(&reader.string()?), Node::decode(reader)?)))
+                    .collect::<Option<_>>()?,
+            ),
+            2 => Node::Array(
+                (0..reader.u32()?)
+                    .map(|_| Node::decode(reader))
+                    .collect::<Option<_>>()?,
+            ),
+            _ => return None,
+        };
+        Some(node)
+    }
+}
+
+/// Scalar fields are set with `RefData::on_value`, thus fields with a custom
+/// `decode` are left to their default
+impl<'a> Tree for &'a Node {
+    fn child(&self, name: &Name) -> Option<Self> {
+        self.get(name)
+    }
+
+    fn num_values(&self) -> usize {
+        self.values().len()
+    }
+
+    fn for_each_value<F: FnMut(Self)>(&self, f: F) {
+        self.values().iter().for_each(f)
+    }
+
+    fn for_each_element<F: FnMut(&Name, Self)>(&self, mut f: F) {
+        for (name, element) in self.elements() {
+            f(name, element)
+        }
+    }
+
+    fn string(&self) -> Option<String> {
+        match self {
+            Node::Value(Value::String(s)) => Some(s.clone()),
+            _ => None,
+        }
+    }
+
+    fn date(&self) -> Option<Date> {
+        match self {
+            Node::Value(Value::Datetime(date)) => session::date_from_days(date.days_since_epoch()),
+            _ => None,
+        }
+    }
+
+    fn set_field<R: RefData>(&self, name: &Name, value: &mut R) {
+        if let Node::Value(v) = self {
+            value.on_value(&name.to_string_lossy(), v);
+        }
+    }
+}
+
+/// Recorded messages, as plain element trees
+#[derive(Debug, Clone, Default)]
+pub struct Recording {
+    messages: Vec<(String, Node)>,
+}
+
+impl Recording {
+    /// Create a new empty recording
+    pub fn new() -> Self {
+        Recording::default()
+    }
+
+    /// Add a message, with its type
+    pub fn push<S: Into<String>>(&mut self, message_type: S, element: Node) {
+        self.messages.push((message_type.into(), element));
+    }
+
+    /// Get recorded messages, with their type
+    pub fn messages(&self) -> &[(String, Node)] {
+        &self.messages
+    }
+
+    /// Save the recording to a file
+    pub fn save<P: AsRef<Path>>(&self, path: P) -> Result<(), Error> {
+        let mut buf = MAGIC.to_vec();
+        buf.extend_from_slice(&(self.messages.len() as u32).to_le_bytes());
+        for (message_type, element) in &self.messages {
+            encode_str(&mut buf, message_type);
+            element.encode(&mut buf);
+        }
+        let mut writer = BufWriter::new(File::create(path)?);
+        writer.write_all(&buf)?;
+        writer.flush()?;
+        Ok(())
+    }
+
+    /// Load a recording saved with `save`
+    pub fn load<P: AsRef<Path>>(path: P) -> Result<Self, Error> {
+        let path = path.as_ref();
+        let mut bytes = Vec::new();
+        File::open(path)?.read_to_end(&mut bytes)?;
+        if !bytes.starts_with(MAGIC) {
+            return Err(Error::NotFound(format!(
+                "recording header in {}",
+                path.display()
+            )));
+        }
+        let mut reader = Reader::new(&bytes[MAGIC.len()..]);
+        let messages = reader.u32().and_then(|len| {
+            (0..len)
+                .map(|_| Some((reader.string()?, Node::decode(&mut reader)?)))
+                .collect::<Option<_>>()
+        });
+        match messages {
+            Some(messages) => Ok(Recording { messages }),
+            None => Err(Error::Io(std::io::Error::new(
+                std::io::ErrorKind::InvalidData,
+                format!("truncated recording {}", path.display()),
+            ))),
+        }
+    }
+
+    /// Decode all `ReferenceDataRequest` responses, as `Replay::ref_data`
+    pub fn ref_data<R: RefData>(&self) -> Result<HashMap<String, R>, Error> {
+        let mut ref_data = HashMap::new();
+        let mut errors = Vec::new();
+        for (_, message) in &self.messages {
+            session::ref_data_message(&message, &mut ref_data, &mut errors);
+        }
+        match errors.into_iter().next() {
+            Some(error) => Err(error),
+            None => Ok(ref_data),
+        }
+    }
+
+    /// Decode all `HistoricalDataRequest` responses, as `Replay::hist_data`
+    pub fn hist_data<R: RefData>(&self) -> Result<HashMap<String, TimeSerie<R>>, Error> {
+        let mut ref_data = HashMap::new();
+        let mut errors = Vec::new();
+        for (_, message) in &self.messages {
+            session::hist_data_message(&message, &mut ref_data, &mut errors);
+        }
+        match errors.into_iter().next() {
+            Some(error) => Err(error),
+            None => Ok(ref_data),
+        }
+    }
+}
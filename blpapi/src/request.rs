@@ -1,11 +1,10 @@
 use crate::{
     element::{Element, SetValue},
-    name::Name,
+    name::{self, Name},
     service::Service,
     Error,
 };
 use blpapi_sys::*;
-use std::ffi::CString;
 
 /// A `Request`
 /// Created from `Service::create_request`
@@ -19,11 +18,11 @@ pub struct Request {
 impl Request {
     /// Create a new request from a `Service`
     pub fn new(service: &Service, operation: &str) -> Result<Self, Error> {
-        let operation = CString::new(operation).unwrap();
+        let mut ptr = std::ptr::null_mut();
+        let res = name::with_c_str(operation, |operation| unsafe {
+            blpapi_Service_createRequest(service.0, &mut ptr as *mut _, operation)
+        });
         unsafe {
-            let mut ptr = std::ptr::null_mut();
-            let refptr = &mut ptr as *mut _;
-            let res = blpapi_Service_createRequest(service.0, refptr, operation.as_ptr());
             Error::check(res)?;
             let elements = blpapi_Request_elements(ptr);
             Ok(Request { ptr, elements })
@@ -31,8 +30,8 @@ impl Request {
     }
 
     /// Convert the request to an Element
-    pub fn element(&self) -> Element {
-        Element { ptr: self.elements }
+    pub fn element(&self) -> Element<'_> {
+        unsafe { Element::new(self.elements) }
     }
 
     /// Append a new value to the existing inner Element sequence defined by name
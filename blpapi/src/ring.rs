@@ -0,0 +1,179 @@
+use std::cell::UnsafeCell;
+use std::marker::PhantomData;
+use std::mem::MaybeUninit;
+use std::ptr;
+use std::sync::atomic::{AtomicPtr, AtomicUsize, Ordering};
+
+/// A bounded, lock-free, single producer / single consumer ring buffer
+///
+/// Only one thread may `push` and only one thread may `pop` at a time.
+pub(crate) struct Ring<T> {
+    buffer: Box<[UnsafeCell<MaybeUninit<T>>]>,
+    mask: usize,
+    /// Next slot to pop, only written by the consumer
+    head: AtomicUsize,
+    /// Next slot to push, only written by the producer
+    tail: AtomicUsize,
+}
+
+unsafe impl<T: Send> Send for Ring<T> {}
+unsafe impl<T: Send> Sync for Ring<T> {}
+
+impl<T> Ring<T> {
+    /// Create a new ring, capacity is rounded up to the next power of 2
+    pub fn with_capacity(capacity: usize) -> Self {
+        let capacity = capacity.max(1).next_power_of_two();
+        let buffer = (0..capacity)
+            .map(|_| UnsafeCell::new(MaybeUninit::uninit()))
+            .collect();
+        Ring {
+            buffer,
+            mask: capacity - 1,
+            head: AtomicUsize::new(0),
+            tail: AtomicUsize::new(0),
+        }
+    }
+
+    /// Push a new value, giving it back if the ring is full
+    pub fn push(&self, value: T) -> Result<(), T> {
+        let tail = self.tail.load(Ordering::Relaxed);
+        let head = self.head.load(Ordering::Acquire);
+        if tail.wrapping_sub(head) > self.mask {
+            return Err(value);
+        }
+        unsafe {
+            (*self.buffer[tail & self.mask].get())
+                .as_mut_ptr()
+                .write(value)
+        };
+        self.tail.store(tail.wrapping_add(1), Ordering::Release);
+        Ok(())
+    }
+
+    /// Pop the oldest value, if any
+    pub fn pop(&self) -> Option<T> {
+        let head = self.head.load(Ordering::Relaxed);
+        let tail = self.tail.load(Ordering::Acquire);
+        if head == tail {
+            return None;
+        }
+        let value = unsafe { (*self.buffer[head & self.mask].get()).as_ptr().read() };
+        self.head.store(head.wrapping_add(1), Ordering::Release);
+        Some(value)
+    }
+}
+
+impl<T> Drop for Ring<T> {
+    fn drop(&mut self) {
+        while self.pop().is_some() {}
+    }
+}
+
+/// A lock-free slot holding at most one boxed value
+///
+/// Values are exchanged with a single atomic swap of their pointer, so both
+/// `put` and `take` can be called concurrently from any thread. Boxes swapped
+/// out of the slot are kept as a spare and reused by the next `put`: once
+/// warm, exchanging values does not allocate.
+pub(crate) struct Swap<T> {
+    ptr: AtomicPtr<MaybeUninit<T>>,
+    /// An empty box, if any
+    spare: AtomicPtr<MaybeUninit<T>>,
+    _value: PhantomData<Box<T>>,
+}
+
+unsafe impl<T: Send> Send for Swap<T> {}
+unsafe impl<T: Send> Sync for Swap<T> {}
+
+impl<T> Default for Swap<T> {
+    fn default() -> Self {
+        Swap {
+            ptr: AtomicPtr::new(ptr::null_mut()),
+            spare: AtomicPtr::new(ptr::null_mut()),
+            _value: PhantomData,
+        }
+    }
+}
+
+impl<T> Swap<T> {
+    /// Put a new value, returning the previous one if any
+    pub fn put(&self, value: T) -> Option<T> {
+        let spare = self.spare.swap(ptr::null_mut(), Ordering::AcqRel);
+        let mut slot = if spare.is_null() {
+            Box::new(MaybeUninit::uninit())
+        } else {
+            unsafe { Box::from_raw(spare) }
+        };
+        unsafe { slot.as_mut_ptr().write(value) };
+        let old = self.ptr.swap(Box::into_raw(slot), Ordering::AcqRel);
+        unsafe { self.recycle(old) }
+    }
+
+    /// Take the value, if any
+    pub fn take(&self) -> Option<T> {
+        let old = self.ptr.swap(ptr::null_mut(), Ordering::AcqRel);
+        unsafe { self.recycle(old) }
+    }
+
+    /// Move the value out of a box swapped out of the slot, and keep the
+    /// box as the spare one
+    unsafe fn recycle(&self, ptr: *mut MaybeUninit<T>) -> Option<T> {
+        if ptr.is_null() {
+            return None;
+        }
+        let value = (*ptr).as_ptr().read();
+        let spare = self.spare.swap(ptr, Ordering::AcqRel);
+        if !spare.is_null() {
+            drop(Box::from_raw(spare));
+        }
+        Some(value)
+    }
+}
+
+impl<T> Drop for Swap<T> {
+    fn drop(&mut self) {
+        self.take();
+        let spare = *self.spare.get_mut();
+        if !spare.is_null() {
+            drop(unsafe { Box::from_raw(spare) });
+        }
+    }
+}
+
+#[test]
+fn ring_push_pop() {
+    let ring = Ring::with_capacity(3);
+    for i in 0..4 {
+        assert!(ring.push(i).is_ok());
+    }
+    assert_eq!(ring.push(4), Err(4));
+    assert_eq!(ring.pop(), Some(0));
+    assert!(ring.push(4).is_ok());
+    assert_eq!(
+        (1..5).collect::<Vec<_>>(),
+        std::iter::from_fn(|| ring.pop()).collect::<Vec<_>>()
+    );
+    assert_eq!(ring.pop(), None);
+}
+
+#[test]
+fn ring_swap() {
+    let swap = Swap::default();
+    assert_eq!(swap.take(), None);
+    assert_eq!(swap.put(1), None);
+    assert_eq!(swap.put(2), Some(1));
+    assert_eq!(swap.take(), Some(2));
+    assert_eq!(swap.take(), None);
+
+    // boxes are reused
+    let spare = swap.spare.load(Ordering::SeqCst);
+    assert!(!spare.is_null());
+    swap.put(3);
+    assert_eq!(swap.ptr.load(Ordering::SeqCst), spare);
+    assert!(swap.spare.load(Ordering::SeqCst).is_null());
+
+    // the value left is dropped with the slot
+    let value = std::sync::Arc::new(());
+    Swap::default().put(value.clone());
+    assert_eq!(std::sync::Arc::strong_count(&value), 1);
+}
@@ -0,0 +1,474 @@
+//! Parallel requests over a pool of sessions
+//!
+//! A `Scheduler` splits large `ref_data`/`hist_data` queries into batches
+//! sized by a cost model (securities x fields x points) and the bloomberg
+//! request limits. Worker threads pull batches, largest first, from a queue
+//! shared by all the sessions of the pool, so a fast session simply takes more
+//! work. Each session has its own concurrency and rate limits.
+//! Responses are decoded on the worker threads, in parallel.
+
+use crate::{
+    event::Event,
+    name,
+    ref_data::RefData,
+    session::{
+        self, HistOptions, SessionSync, TimeSerie, MAX_HISTDATA_FIELDS, MAX_PENDING_REQUEST,
+        MAX_REFDATA_FIELDS,
+    },
+    session_async::SessionAsync,
+    session_options::SessionOptions,
+    Error,
+};
+use futures::{executor::block_on, StreamExt};
+use std::collections::{HashMap, VecDeque};
+use std::sync::Mutex;
+use std::thread;
+use std::time::{Duration, Instant};
+
+/// Default maximum cost (securities x fields x points) of a single request
+const MAX_BATCH_COST: usize = 100_000;
+
+/// Per session limits
+#[derive(Debug, Clone, Copy)]
+pub struct Limits {
+    /// Maximum number of requests in flight
+    max_in_flight: usize,
+    /// Minimum interval between two requests
+    min_interval: Duration,
+}
+
+impl Default for Limits {
+    fn default() -> Self {
+        Limits {
+            max_in_flight: 4,
+            min_interval: Duration::from_millis(0),
+        }
+    }
+}
+
+impl Limits {
+    /// Set the maximum number of requests in flight (at least 1)
+    pub fn with_max_in_flight(mut self, max_in_flight: usize) -> Self {
+        self.max_in_flight = max_in_flight.max(1);
+        self
+    }
+
+    /// Set the minimum interval between two requests sent to the session
+    pub fn with_min_interval(mut self, min_interval: Duration) -> Self {
+        self.min_interval = min_interval;
+        self
+    }
+}
+
+/// A session of the pool
+struct Slot {
+    session: SessionAsync,
+    limits: Limits,
+    /// Earliest time the next request can be sent
+    next_send: Mutex<Instant>,
+}
+
+impl Slot {
+    /// Wait until the rate limit allows sending a new request
+    fn wait_turn(&self) {
+        let now = Instant::now();
+        let at = {
+            let mut next_send = self.next_send.lock().unwrap();
+            let at = (*next_send).max(now);
+            *next_send = at + self.limits.min_interval;
+            at
+        };
+        if at > now {
+            thread::sleep(at - now);
+        }
+    }
+}
+
+/// A batch of securities, processed by a single worker
+///
+/// It is sent as one request per chunk of fields so that all the fields of a
+/// security are decoded into the same value.
+struct Batch<'a, S> {
+    securities: &'a [S],
+    fields: Vec<&'static [&'static str]>,
+    cost: usize,
+}
+
+/// Results of a scheduled query
+///
+/// Failures don't abort the query: securities in error and failed batches
+/// are reported in `errors` while all the other results are kept. A batch
+/// failure (request failure, `responseError`, terminated session ...) is an
+/// `Error::Batch` holding the securities of the batch.
+#[derive(Debug)]
+pub struct Report<T> {
+    pub data: HashMap<String, T>,
+    pub errors: Vec<Error>,
+}
+
+impl<T> Default for Report<T> {
+    fn default() -> Self {
+        Report {
+            data: HashMap::new(),
+            errors: Vec::new(),
+        }
+    }
+}
+
+/// A pool of sessions sharing the requests of large queries
+///
+/// # Example
+///
+/// ```
+/// # #[cfg(all(feature = "derive", feature = "async"))]
+/// # {
+/// use blpapi::{
+///     RefData,
+///     scheduler::{Limits, Scheduler},
+///     session_options::SessionOptions,
+/// };
+/// use std::time::Duration;
+///
+/// #[derive(Default, RefData)]
+/// struct EquityData {
+///     ticker: String,
+///     crncy: String,
+/// }
+///
+/// let limits = Limits::default()
+///     .with_max_in_flight(8)
+///     .with_min_interval(Duration::from_millis(10));
+/// let scheduler = Scheduler::new()
+///     .with_session(SessionOptions::default(), limits)
+///     .unwrap();
+/// let securities: &[&str] = &[ /* list of security tickers */ ];
+///
+/// let report = scheduler.ref_data::<_, EquityData>(securities);
+/// for error in &report.errors { /* ... */ }
+/// # }
+/// ```
+pub struct Scheduler {
+    slots: Vec<Slot>,
+    max_batch_cost: usize,
+}
+
+impl Default for Scheduler {
+    fn default() -> Self {
+        Scheduler::new()
+    }
+}
+
+impl Scheduler {
+    /// Create a new scheduler without any session
+    pub fn new() -> Self {
+        Scheduler {
+            slots: Vec::new(),
+            max_batch_cost: MAX_BATCH_COST,
+        }
+    }
+
+    /// Start a new session, open refdata service and add it to the pool
+    pub fn with_session(self, options: SessionOptions, limits: Limits) -> Result<Self, Error> {
+        let mut session = SessionSync::from_options(options);
+        session.start()?;
+        session.open_service("//blp/refdata")?;
+        Ok(self.with_session_async(SessionAsync::from_sync(session), limits))
+    }
+
+    /// Add an already started session to the pool
+    pub fn with_session_async(mut self, session: SessionAsync, limits: Limits) -> Self {
+        self.slots.push(Slot {
+            session,
+            limits,
+            next_send: Mutex::new(Instant::now()),
+        });
+        self
+    }
+
+    /// Set the maximum cost (securities x fields x points) of a single request
+    pub fn with_max_batch_cost(mut self, max_batch_cost: usize) -> Self {
+        self.max_batch_cost = max_batch_cost.max(1);
+        self
+    }
+
+    /// Number of sessions in the pool
+    pub fn len(&self) -> usize {
+        self.slots.len()
+    }
+
+    /// Is empty
+    pub fn is_empty(&self) -> bool {
+        self.slots.is_empty()
+    }
+
+    /// Get reference data for `RefData` items
+    pub fn ref_data<I, R>(&self, securities: I) -> Report<R>
+    where
+        I: IntoIterator,
+        I::Item: AsRef<str> + Sync,
+        R: RefData + Send,
+    {
+        let securities: Vec<I::Item> = securities.into_iter().collect();
+        let batches = self.plan(&securities, R::FIELDS, MAX_REFDATA_FIELDS, 1);
+        self.run(
+            batches,
+            "ReferenceDataRequest",
+            None,
+            session::ref_data_event::<R>,
+        )
+    }
+
+    /// Get historical data
+    pub fn hist_data<I, R>(&self, securities: I, options: HistOptions) -> Report<TimeSerie<R>>
+    where
+        I: IntoIterator,
+        I::Item: AsRef<str> + Sync,
+        R: RefData + Send,
+    {
+        let securities: Vec<I::Item> = securities.into_iter().collect();
+        let points = options.points();
+        let batches = self.plan(&securities, R::FIELDS, MAX_HISTDATA_FIELDS, points);
+        self.run(
+            batches,
+            "HistoricalDataRequest",
+            Some(&options),
+            session::hist_data_event::<R>,
+        )
+    }
+
+    /// Split (securities x fields) into batches complying with bloomberg size
+    /// limitations and `max_batch_cost`, largest first
+    fn plan<'a, S>(
+        &self,
+        securities: &'a [S],
+        fields: &'static [&'static str],
+        max_fields: usize,
+        points: usize,
+    ) -> VecDeque<Batch<'a, S>> {
+        let chunks = fields.chunks(max_fields).collect::<Vec<_>>();
+        let max_chunk = match chunks.iter().map(|c| c.len()).max() {
+            Some(max_chunk) => max_chunk,
+            None => return VecDeque::new(),
+        };
+        let max_securities = (MAX_PENDING_REQUEST / max_chunk)
+            .min(self.max_batch_cost / (max_chunk * points))
+            .max(1);
+        let mut batches = securities
+            .chunks(max_securities)
+            .map(|securities| Batch {
+                securities,
+                fields: chunks.clone(),
+                cost: securities.len() * fields.len() * points,
+            })
+            .collect::<Vec<_>>();
+        batches.sort_by(|a, b| b.cost.cmp(&a.cost));
+        batches.into()
+    }
+
+    /// Process all the batches on every session of the pool
+    fn run<S, T, F>(
+        &self,
+        batches: VecDeque<Batch<S>>,
+        operation: &str,
+        options: Option<&HistOptions>,
+        decode: F,
+    ) -> Report<T>
+    where
+        S: AsRef<str> + Sync,
+        T: Send,
+        F: Fn(&Event, &mut HashMap<String, T>, &mut Vec<Error>) + Sync,
+    {
+        let mut report = Report::default();
+        if self.slots.is_empty() {
+            if !batches.is_empty() {
+                report.errors.push(Error::NotFound("session".into()));
+            }
+            return report;
+        }
+
+        let queue = Mutex::new(batches);
+        let workers = thread::scope(|scope| {
+            let workers = self
+                .slots
+                .iter()
+                .flat_map(|slot| (0..slot.limits.max_in_flight).map(move |_| slot))
+                .map(|slot| {
+                    let (queue, decode) = (&queue, &decode);
+                    scope.spawn(move || work(slot, queue, operation, options, decode))
+                })
+                .collect::<Vec<_>>();
+            workers
+                .into_iter()
+                .map(|worker| worker.join().unwrap())
+                .collect::<Vec<_>>()
+        });
+
+        for worker in workers {
+            report.data.extend(worker.data);
+            report.errors.extend(worker.errors);
+        }
+        // left by sessions terminated after all the others
+        for batch in queue.into_inner().unwrap() {
+            report.errors.push(batch.failed(Error::SessionTerminated));
+        }
+        report
+    }
+}
+
+impl<'a, S: AsRef<str>> Batch<'a, S> {
+    /// A batch failure, with the securities of the batch
+    fn failed(&self, error: Error) -> Error {
+        Error::Batch {
+            securities: self
+                .securities
+                .iter()
+                .map(|s| s.as_ref().to_owned())
+                .collect(),
+            error: Box::new(error),
+        }
+    }
+}
+
+/// Is `error` a failure of the whole session, rather than of a request
+fn is_fatal(error: &Error) -> bool {
+    match error {
+        Error::SessionTerminated => true,
+        _ => false,
+    }
+}
+
+/// Pop batches from the shared queue and `process` them, until the queue is empty
+///
+/// `process` fails on a fatal error only: the batch is put back on the queue
+/// for the other sessions and the worker stops.
+fn drain<S, T, P>(queue: &Mutex<VecDeque<Batch<S>>>, mut process: P) -> Report<T>
+where
+    P: FnMut(&Batch<S>, &mut Report<T>) -> Result<(), Error>,
+{
+    let mut report = Report::default();
+    loop {
+        let batch = match queue.lock().unwrap().pop_front() {
+            Some(batch) => batch,
+            None => return report,
+        };
+        if let Err(e) = process(&batch, &mut report) {
+            log::warn!("session failed, stopping its worker: {}", e);
+            queue.lock().unwrap().push_front(batch);
+            return report;
+        }
+    }
+}
+
+/// Send batches from the shared queue to `slot` session, one at a time,
+/// until the queue is empty or the session fails
+fn work<S, T, F>(
+    slot: &Slot,
+    queue: &Mutex<VecDeque<Batch<S>>>,
+    operation: &str,
+    options: Option<&HistOptions>,
+    decode: &F,
+) -> Report<T>
+where
+    S: AsRef<str>,
+    F: Fn(&Event, &mut HashMap<String, T>, &mut Vec<Error>),
+{
+    drain(queue, |batch, report| {
+        for fields in &batch.fields {
+            slot.wait_turn();
+            // a single request, batches comply with bloomberg size limitations
+            let sent = slot
+                .session
+                .create_requests(operation, batch.securities, fields, options)
+                .and_then(|mut requests| slot.session.send(requests.remove(0)));
+            let mut responses = match sent {
+                Ok(responses) => responses,
+                Err(e) if is_fatal(&e) => return Err(e),
+                Err(e) => {
+                    report.errors.push(batch.failed(e));
+                    continue;
+                }
+            };
+            block_on(async {
+                while let Some(event) = responses.next().await {
+                    let event = match event {
+                        Ok(event) => event,
+                        Err(e) if is_fatal(&e) => return Err(e),
+                        Err(e) => {
+                            report.errors.push(batch.failed(e));
+                            continue;
+                        }
+                    };
+                    for message in event.messages().map(|m| m.element()) {
+                        if let Some(error) = message.get_named_element(&name::RESPONSE_ERROR) {
+                            report.errors.push(batch.failed(Error::request(error)));
+                        }
+                    }
+                    decode(&event, &mut report.data, &mut report.errors);
+                }
+                Ok(())
+            })?;
+        }
+        Ok(())
+    })
+}
+
+#[test]
+fn plan() {
+    const FIELDS: &[&str] = &["PX_LAST", "PX_OPEN", "PX_HIGH", "PX_LOW"];
+    let securities = (0..1000).map(|i| i.to_string()).collect::<Vec<_>>();
+    let scheduler = Scheduler::new().with_max_batch_cost(3 * 365 * 100);
+
+    // ref data: limited by the number of pending requests
+    let batches = scheduler.plan(&securities, FIELDS, MAX_REFDATA_FIELDS, 1);
+    assert_eq!(batches.len(), 4);
+    assert!(batches
+        .iter()
+        .all(|b| b.securities.len() * FIELDS.len() <= MAX_PENDING_REQUEST));
+
+    // hist data: limited by the cost of the largest request, largest first
+    let mut securities = securities;
+    securities.truncate(950);
+    let batches = scheduler.plan(&securities, FIELDS, 3, 365);
+    assert_eq!(batches.len(), 10);
+    assert_eq!(batches[0].fields, vec![&FIELDS[..3], &FIELDS[3..]]);
+    assert_eq!(batches[0].securities.len(), 100);
+    assert_eq!(batches[9].securities.len(), 50);
+    assert!(batches
+        .iter()
+        .zip(batches.iter().skip(1))
+        .all(|(a, b)| a.cost >= b.cost));
+}
+
+#[test]
+fn drain_requeue() {
+    let securities = (0..4).map(|i| i.to_string()).collect::<Vec<_>>();
+    let batch = |i: usize| Batch {
+        securities: &securities[i..i + 1],
+        fields: Vec::new(),
+        cost: 1,
+    };
+    let queue = Mutex::new((0..4).map(batch).collect::<VecDeque<_>>());
+
+    // a terminated session processes one batch, then gives back the next one
+    let mut calls = 0;
+    let dead = drain(&queue, |batch, report: &mut Report<()>| {
+        calls += 1;
+        if calls > 1 {
+            return Err(Error::SessionTerminated);
+        }
+        report.errors.push(batch.failed(Error::TimeOut));
+        Ok(())
+    });
+    assert_eq!(dead.errors.len(), 1);
+    assert_eq!(queue.lock().unwrap().len(), 3);
+
+    // which a healthy session processes
+    let healthy = drain(&queue, |batch, report: &mut Report<()>| {
+        report.data.insert(batch.securities[0].clone(), ());
+        Ok(())
+    });
+    let mut done = healthy.data.keys().cloned().collect::<Vec<_>>();
+    done.sort();
+    assert_eq!(done, vec!["1", "2", "3"]);
+    assert!(queue.lock().unwrap().is_empty());
+}
@@ -1,32 +1,46 @@
 use crate::{
+    columnar::{self, Columns},
     correlation_id::CorrelationId,
+    datetime::{civil_from_days, days_from_civil},
     element::Element,
     event::{Event, EventType},
-    name,
-    ref_data::RefData,
+    intraday::{self, Bar, BarOptions, Tick, TickOptions, Window},
+    name::{self, Name},
+    ref_data::{FieldIndex, RefData},
+    replay::{EventSource, Replay},
     request::Request,
     service::Service,
     session_options::SessionOptions,
+    stream::{self, Stream},
+    subscription_list::SubscriptionList,
     Error,
 };
 use blpapi_sys::*;
-use std::collections::HashMap;
-use std::{ffi::CString, ptr};
+use std::cell::Cell;
+use std::collections::{HashMap, VecDeque};
+use std::ptr;
+use std::rc::Rc;
+use std::sync::atomic::{AtomicU64, Ordering};
 
-const MAX_PENDING_REQUEST: usize = 1024;
-const MAX_REFDATA_FIELDS: usize = 400;
-const MAX_HISTDATA_FIELDS: usize = 25;
+pub(crate) const MAX_PENDING_REQUEST: usize = 1024;
+pub(crate) const MAX_REFDATA_FIELDS: usize = 400;
+pub(crate) const MAX_HISTDATA_FIELDS: usize = 25;
 
 pub struct Session {
     ptr: *mut blpapi_Session_t,
     // keep a handle of the options (not sure if it should be droped or not)
     //_options: SessionOptions,
-    correlation_count: u64,
+    correlation_count: AtomicU64,
 }
 
+// blpapi sessions are thread safe: requests can be sent from one thread
+// while another one is waiting on `nextEvent`
+unsafe impl Send for Session {}
+unsafe impl Sync for Session {}
+
 impl Session {
     /// Create a new session
-    fn from_options(options: SessionOptions) -> Self {
+    pub(crate) fn from_options(options: SessionOptions) -> Self {
         //TODO: check if null values are ok!
         let handler = None;
         let dispatcher = ptr::null_mut();
@@ -35,7 +49,7 @@ impl Session {
         Session {
             ptr,
             //_options: options,
-            correlation_count: 0,
+            correlation_count: AtomicU64::new(0),
         }
     }
 
@@ -52,25 +66,27 @@ impl Session {
     }
 
     /// Open service
-    pub fn open_service(&mut self, service: &str) -> Result<(), Error> {
-        let service = CString::new(service).unwrap();
-        let res = unsafe { blpapi_Session_openService(self.ptr, service.as_ptr()) };
+    pub fn open_service(&self, service: &str) -> Result<(), Error> {
+        let res = name::with_c_str(service, |service| unsafe {
+            blpapi_Session_openService(self.ptr, service)
+        });
         Error::check(res)
     }
 
     /// Get opened service
     pub fn get_service(&self, service: &str) -> Result<Service, Error> {
-        let name = CString::new(service).unwrap();
-        let mut service = ptr::null_mut();
-        let res =
-            unsafe { blpapi_Session_getService(self.ptr, &mut service as *mut _, name.as_ptr()) };
+        let mut service_ptr = ptr::null_mut();
+        let res = name::with_c_str(service, |service| unsafe {
+            blpapi_Session_getService(self.ptr, &mut service_ptr as *mut _, service)
+        });
+        let service = service_ptr;
         Error::check(res)?;
         Ok(Service(service))
     }
 
     /// Send request
     pub fn send(
-        &mut self,
+        &self,
         request: Request,
         correlation_id: Option<CorrelationId>,
     ) -> Result<CorrelationId, Error> {
@@ -94,10 +110,80 @@ impl Session {
         }
     }
 
-    fn new_correlation_id(&mut self) -> CorrelationId {
-        let id = CorrelationId::new_u64(self.correlation_count);
-        self.correlation_count += 1;
-        id
+    /// Subscribe to all the topics of the list
+    pub fn subscribe(&self, list: &SubscriptionList) -> Result<(), Error> {
+        let identity = ptr::null();
+        let request_label = ptr::null();
+        let request_label_len = 0;
+        let res = unsafe {
+            blpapi_Session_subscribe(self.ptr, list.0, identity, request_label, request_label_len)
+        };
+        Error::check(res)
+    }
+
+    /// Unsubscribe from all the topics of the list
+    pub fn unsubscribe(&self, list: &SubscriptionList) -> Result<(), Error> {
+        let request_label = ptr::null();
+        let request_label_len = 0;
+        let res = unsafe {
+            blpapi_Session_unsubscribe(self.ptr, list.0, request_label, request_label_len)
+        };
+        Error::check(res)
+    }
+
+    /// Request for next event, optionally waiting timeout_ms if there is no event
+    pub fn next_event(&self, timeout_ms: Option<u32>) -> Result<Event, Error> {
+        let mut event = ptr::null_mut();
+        let timeout = timeout_ms.unwrap_or(0);
+        unsafe {
+            let res = blpapi_Session_nextEvent(self.ptr, &mut event as *mut _, timeout);
+            Error::check(res)?;
+            Ok(Event(event))
+        }
+    }
+
+    pub(crate) fn new_correlation_id(&self) -> CorrelationId {
+        let id = self.correlation_count.fetch_add(1, Ordering::Relaxed);
+        CorrelationId::new_u64(id)
+    }
+
+    /// Create as many `ReferenceDataRequest` (no `options`) or `HistoricalDataRequest`
+    /// as necessary for securities x fields
+    pub(crate) fn create_requests<S: AsRef<str>>(
+        &self,
+        operation: &str,
+        securities: &[S],
+        fields: &[&str],
+        options: Option<&HistOptions>,
+    ) -> Result<Vec<Request>, Error> {
+        let service = self.get_service("//blp/refdata")?;
+        let max_fields = match options {
+            Some(_) => MAX_HISTDATA_FIELDS,
+            None => MAX_REFDATA_FIELDS,
+        };
+
+        // split request as necessary to comply with bloomberg size limitations
+        let mut requests = Vec::new();
+        for fields in fields.chunks(max_fields) {
+            for securities in securities.chunks((MAX_PENDING_REQUEST / fields.len()).max(1)) {
+                // create new request
+                let mut request = service.create_request(operation)?;
+
+                // add securities and fields
+                for security in securities {
+                    request.append_named(&name::SECURITIES, security.as_ref())?;
+                }
+                for field in fields {
+                    request.append_named(&name::FIELDS_NAME, *field)?;
+                }
+
+                if let Some(options) = options {
+                    options.apply(&mut request)?;
+                }
+                requests.push(request);
+            }
+        }
+        Ok(requests)
     }
 }
 
@@ -108,12 +194,29 @@ impl Drop for Session {
 }
 
 /// A wrapper for session which only show sync fn
-pub struct SessionSync(Session);
+pub struct SessionSync {
+    pub(crate) session: Session,
+    /// Events received so far, when recording
+    recording: Option<Vec<Event>>,
+}
 
 impl SessionSync {
     /// Create a new `SessionSync` from a `SessionOptions`
     pub fn from_options(options: SessionOptions) -> Self {
-        SessionSync(Session::from_options(options))
+        SessionSync {
+            session: Session::from_options(options),
+            recording: None,
+        }
+    }
+
+    /// Start recording all the received events
+    pub fn start_recording(&mut self) {
+        self.recording = Some(Vec::new());
+    }
+
+    /// Stop recording and get the recorded events
+    pub fn stop_recording(&mut self) -> Replay {
+        Replay::new(self.recording.take().unwrap_or_default())
     }
 
     /// Create a new `SessionSync` with default options and open refdata service
@@ -130,21 +233,10 @@ impl SessionSync {
         request: Request,
         correlation_id: Option<CorrelationId>,
     ) -> Result<Events, Error> {
-        let _id = (&mut *self as &mut Session).send(request, correlation_id)?;
+        let _id = self.session.send(request, correlation_id)?;
         Ok(Events::new(self))
     }
 
-    /// Request for next event, optionally waiting timeout_ms if there is no event
-    pub fn next_event(&mut self, timeout_ms: Option<u32>) -> Result<Event, Error> {
-        let mut event = ptr::null_mut();
-        let timeout = timeout_ms.unwrap_or(0);
-        unsafe {
-            let res = blpapi_Session_nextEvent(self.0.ptr, &mut event as *mut _, timeout);
-            Error::check(res)?;
-            Ok(Event(event))
-        }
-    }
-
     /// Get reference data for `RefData` items
     ///
     /// # Note
@@ -177,58 +269,19 @@ impl SessionSync {
         I::Item: AsRef<str>,
         R: RefData,
     {
-        let service = self.get_service("//blp/refdata")?;
+        let securities: Vec<I::Item> = securities.into_iter().collect();
         let mut ref_data: HashMap<String, R> = HashMap::new();
-        let mut iter = securities.into_iter();
-
-        // split request as necessary to comply with bloomberg size limitations
-        for fields in R::FIELDS.chunks(MAX_REFDATA_FIELDS) {
-            loop {
-                // create new request
-                let mut request = service.create_request("ReferenceDataRequest")?;
-
-                // add next batch of securities and exit loop if empty
-                let mut is_empty = true;
-                for security in iter.by_ref().take(MAX_PENDING_REQUEST / fields.len()) {
-                    request.append_named(&name::SECURITIES, security.as_ref())?;
-                    is_empty = false;
-                }
-                if is_empty {
-                    break;
-                }
-
-                // add fields
-                for field in fields {
-                    request.append_named(&name::FIELDS_NAME, *field)?;
-                }
-
-                // send request
-                for event in self.send(request, None)? {
-                    for message in event?.messages().map(|m| m.element()) {
-                        if let Some(securities) = message.get_named_element(&name::SECURITY_DATA) {
-                            for security in securities.values::<Element>() {
-                                let ticker = security
-                                    .get_named_element(&name::SECURITY_NAME)
-                                    .and_then(|s| s.get_at(0))
-                                    .unwrap_or_else(String::new);
-                                if let Some(error) =
-                                    security.get_named_element(&name::SECURITY_ERROR)
-                                {
-                                    return Err(Error::security(ticker, error));
-                                }
-                                let entry = ref_data.entry(ticker).or_default();
-                                if let Some(fields) = security.get_named_element(&name::FIELD_DATA)
-                                {
-                                    for field in fields.elements() {
-                                        entry.on_field(&field.string_name(), &field);
-                                    }
-                                }
-                            }
-                        }
-                    }
-                }
-            }
-        }
+        let mut errors = Vec::new();
+        self.request_events(
+            "ReferenceDataRequest",
+            &securities,
+            R::FIELDS,
+            None,
+            |event| {
+                ref_data_event(event, &mut ref_data, &mut errors);
+                errors.drain(..).next().map_or(Ok(()), Err)
+            },
+        )?;
         Ok(ref_data)
     }
 
@@ -267,99 +320,456 @@ impl SessionSync {
         I::Item: AsRef<str>,
         R: RefData,
     {
-        let service = self.get_service("//blp/refdata")?;
+        let securities: Vec<I::Item> = securities.into_iter().collect();
         let mut ref_data: HashMap<String, TimeSerie<R>> = HashMap::new();
-        let mut iter = securities.into_iter();
+        let mut errors = Vec::new();
+        self.request_events(
+            "HistoricalDataRequest",
+            &securities,
+            R::FIELDS,
+            Some(&options),
+            |event| {
+                hist_data_event(event, &mut ref_data, &mut errors);
+                errors.drain(..).next().map_or(Ok(()), Err)
+            },
+        )?;
+        Ok(ref_data)
+    }
 
-        // split request as necessary to comply with bloomberg size limitations
-        for fields in R::FIELDS.chunks(MAX_HISTDATA_FIELDS) {
-            loop {
-                // create new request
-                let mut request = service.create_request("HistoricalDataRequest")?;
+    /// Get historical data, decoded into one column per field
+    ///
+    /// Values are stored in contiguous arrow compatible buffers, see `columnar` module.
+    ///
+    /// # Example
+    ///
+    /// ```
+    /// use blpapi::session::{SessionSync, HistOptions};
+    ///
+    /// let mut session = SessionSync::new().unwrap();
+    /// let securities: &[&str] = &[ /* list of security tickers */ ];
+    ///
+    /// let options = HistOptions::new("20190101", "20191231");
+    /// let prices = session.hist_data_columnar(securities, &["PX_LAST", "VOLUME"], options);
+    /// ```
+    pub fn hist_data_columnar<I>(
+        &mut self,
+        securities: I,
+        fields: &[&str],
+        options: HistOptions,
+    ) -> Result<HashMap<String, Columns>, Error>
+    where
+        I: IntoIterator,
+        I::Item: AsRef<str>,
+    {
+        let securities: Vec<I::Item> = securities.into_iter().collect();
+        let index = FieldIndex::new(fields);
+        let mut columns = HashMap::new();
+        self.request_events(
+            "HistoricalDataRequest",
+            &securities,
+            fields,
+            Some(&options),
+            |event| {
+                columnar::hist_data_event(event, &index, &mut columns);
+                Ok(())
+            },
+        )?;
+        Ok(columns)
+    }
 
-                // add next batch of securities and exit loop if empty
-                let mut is_empty = true;
-                for security in iter.by_ref().take(MAX_PENDING_REQUEST / fields.len()) {
-                    request.append_named(&name::SECURITIES, security.as_ref())?;
-                    is_empty = false;
+    /// Stream reference data, one `(ticker, value)` item per security
+    ///
+    /// See `stream` module. If `R` has more fields than a single request can
+    /// hold, a security gets one item per chunk of fields, with only these
+    /// fields set.
+    ///
+    /// # Example
+    ///
+    /// ```
+    /// # #[cfg(feature = "derive")]
+    /// # {
+    /// use blpapi::{RefData, session::SessionSync};
+    ///
+    /// #[derive(Default, RefData)]
+    /// struct EquityData {
+    ///     ticker: String,
+    ///     crncy: String,
+    /// }
+    ///
+    /// let mut session = SessionSync::new().unwrap();
+    /// let securities: &[&str] = &[ /* list of security tickers */ ];
+    ///
+    /// for item in session.ref_data_stream::<_, EquityData>(securities).unwrap() {
+    ///     match item {
+    ///         Ok((ticker, equity)) => { /* ... */ }
+    ///         Err(e) => { /* security error ... */ }
+    ///     }
+    /// }
+    /// # }
+    /// ```
+    pub fn ref_data_stream<'a, I, R>(
+        &'a mut self,
+        securities: I,
+    ) -> Result<Stream<'a, (String, R)>, Error>
+    where
+        I: IntoIterator,
+        I::Item: AsRef<str>,
+        R: RefData + 'a,
+    {
+        let securities: Vec<I::Item> = securities.into_iter().collect();
+        let requests =
+            self.create_requests("ReferenceDataRequest", &securities, R::FIELDS, None)?;
+        Ok(Stream::new(
+            self,
+            requests.into_iter().map(Ok),
+            stream::ref_data_event::<R>,
+        ))
+    }
+
+    /// Stream historical data, one `(ticker, time serie)` item per security
+    ///
+    /// See `stream` module. If `R` has more fields than a single request can
+    /// hold, a security gets one item per chunk of fields, with only these
+    /// fields set.
+    pub fn hist_data_stream<'a, I, R>(
+        &'a mut self,
+        securities: I,
+        options: HistOptions,
+    ) -> Result<Stream<'a, (String, TimeSerie<R>)>, Error>
+    where
+        I: IntoIterator,
+        I::Item: AsRef<str>,
+        R: RefData + 'a,
+    {
+        let securities: Vec<I::Item> = securities.into_iter().collect();
+        let requests = self.create_requests(
+            "HistoricalDataRequest",
+            &securities,
+            R::FIELDS,
+            Some(&options),
+        )?;
+        Ok(Stream::new(
+            self,
+            requests.into_iter().map(Ok),
+            stream::hist_data_event::<R>,
+        ))
+    }
+
+    /// Stream the intraday bars of a security
+    ///
+    /// One request is sent per `options` window, see `stream` module.
+    ///
+    /// # Example
+    ///
+    /// ```
+    /// use blpapi::{
+    ///     datetime::Datetime,
+    ///     intraday::BarOptions,
+    ///     session::SessionSync,
+    ///     stream::Csv,
+    /// };
+    /// use std::{io::BufWriter, time::Duration};
+    ///
+    /// let mut session = SessionSync::new().unwrap();
+    ///
+    /// let start = Datetime::from_ymd_hms(2019, 12, 2, 14, 30, 0);
+    /// let end = Datetime::from_ymd_hms(2019, 12, 6, 21, 0, 0);
+    /// let options = BarOptions::new(start, end, 1).with_window(Duration::from_secs(86_400));
+    /// let csv = Csv::new(BufWriter::new(std::io::stdout()));
+    /// let errors = session
+    ///     .intraday_bars("IBM US Equity", options)
+    ///     .and_then(|bars| bars.forward(csv));
+    /// ```
+    pub fn intraday_bars(
+        &mut self,
+        security: &str,
+        options: BarOptions,
+    ) -> Result<Stream<'_, Bar>, Error> {
+        let windows = options.windows();
+        self.intraday(
+            "IntradayBarRequest",
+            security,
+            windows,
+            move |request, security, window| options.apply(request, security, window),
+            intraday::bars_event,
+        )
+    }
+
+    /// Stream the intraday ticks of a security
+    ///
+    /// One request is sent per `options` window, see `stream` module.
+    pub fn intraday_ticks(
+        &mut self,
+        security: &str,
+        options: TickOptions,
+    ) -> Result<Stream<'_, Tick>, Error> {
+        let windows = options.windows();
+        self.intraday(
+            "IntradayTickRequest",
+            security,
+            windows,
+            move |request, security, window| options.apply(request, security, window),
+            intraday::ticks_event,
+        )
+    }
+
+    /// Stream an intraday request, one request per window
+    fn intraday<T, A>(
+        &mut self,
+        operation: &'static str,
+        security: &str,
+        windows: Vec<Window>,
+        apply: A,
+        decode: fn(&Event, &str, Option<i64>, &mut VecDeque<Result<T, Error>>),
+    ) -> Result<Stream<'_, T>, Error>
+    where
+        T: 'static,
+        A: Fn(&mut Request, &str, &Window) -> Result<(), Error> + 'static,
+    {
+        let service = self.get_service("//blp/refdata")?;
+        let (request_security, security) = (security.to_owned(), security.to_owned());
+        // end of the window of the request in flight, requests are sent one
+        // at a time, only once the previous one is fully decoded
+        let until = Rc::new(Cell::new(None));
+        let request_until = until.clone();
+        let requests = windows.into_iter().map(move |window| {
+            request_until.set(window.until);
+            let mut request = service.create_request(operation)?;
+            apply(&mut request, &request_security, &window)?;
+            Ok(request)
+        });
+        Ok(Stream::new(self, requests, move |event, items| {
+            decode(event, &security, until.get(), items)
+        }))
+    }
+
+    /// Send as many `ReferenceDataRequest` (no `options`) or `HistoricalDataRequest`
+    /// as necessary for securities x fields and process each response event
+    pub(crate) fn request_events<S, F>(
+        &mut self,
+        operation: &str,
+        securities: &[S],
+        fields: &[&str],
+        options: Option<&HistOptions>,
+        mut on_event: F,
+    ) -> Result<(), Error>
+    where
+        S: AsRef<str>,
+        F: FnMut(&Event) -> Result<(), Error>,
+    {
+        for request in self.create_requests(operation, securities, fields, options)? {
+            for event in self.send(request, None)? {
+                on_event(&event?)?;
+            }
+        }
+        Ok(())
+    }
+}
+
+/// A read only element tree, decoded by the response decoders
+///
+/// Implemented by `Element` and by recorded `replay::Node`s, so that
+/// recordings are decoded by the same code as live responses.
+pub(crate) trait Tree: Sized {
+    /// Sub element by name
+    fn child(&self, name: &Name) -> Option<Self>;
+
+    /// Number of values
+    fn num_values(&self) -> usize;
+
+    /// Call `f` on each value of an array
+    fn for_each_value<F: FnMut(Self)>(&self, f: F);
+
+    /// Call `f` on each sub element, with its name
+    fn for_each_element<F: FnMut(&Name, Self)>(&self, f: F);
+
+    /// First value, as a string
+    fn string(&self) -> Option<String>;
+
+    /// First value, as a date
+    fn date(&self) -> Option<Date>;
+
+    /// Set the `name` field of `value` from this element
+    fn set_field<R: RefData>(&self, name: &Name, value: &mut R);
+
+    /// First value of a sub element, as a string
+    fn child_string(&self, name: &Name) -> Option<String> {
+        self.child(name)?.string()
+    }
+}
+
+impl<'a> Tree for Element<'a> {
+    fn child(&self, name: &Name) -> Option<Self> {
+        self.get_named_element(name)
+    }
+
+    fn num_values(&self) -> usize {
+        Element::num_values(self)
+    }
+
+    fn for_each_value<F: FnMut(Self)>(&self, f: F) {
+        self.values::<Element>().for_each(f)
+    }
+
+    fn for_each_element<F: FnMut(&Name, Self)>(&self, mut f: F) {
+        for element in self.elements() {
+            f(&element.name(), element)
+        }
+    }
+
+    fn string(&self) -> Option<String> {
+        self.get_at(0)
+    }
+
+    fn date(&self) -> Option<Date> {
+        self.get_at(0)
+    }
+
+    fn set_field<R: RefData>(&self, name: &Name, value: &mut R) {
+        value.on_named_field(name, self)
+    }
+}
+
+/// Ticker of a `securityData` element, or its security error
+pub(crate) fn security_ticker<T: Tree>(security: &T) -> Result<String, Error> {
+    let ticker = security
+        .child_string(&name::SECURITY_NAME)
+        .unwrap_or_else(String::new);
+    match security.child(&name::SECURITY_ERROR) {
+        Some(error) => Err(Error::security(ticker, error)),
+        None => Ok(ticker),
+    }
+}
+
+/// Decode the `fieldData` of a reference data `securityData` element into `value`
+pub(crate) fn decode_fields<R: RefData, T: Tree>(security: &T, value: &mut R) {
+    if let Some(fields) = security.child(&name::FIELD_DATA) {
+        fields.for_each_element(|name, field| field.set_field(name, value));
+    }
+}
+
+/// Decode the `fieldData` points of a historical data `securityData` element into `serie`
+///
+/// Requests with more than `MAX_HISTDATA_FIELDS` fields are split, each chunk
+/// of fields being returned for the same dates: points are merged by date
+/// into the values already in `serie`.
+pub(crate) fn decode_points<R: RefData, T: Tree>(security: &T, serie: &mut TimeSerie<R>) {
+    if let Some(fields) = security.child(&name::FIELD_DATA) {
+        if serie.values.is_empty() {
+            serie.dates.reserve(fields.num_values());
+            serie.values.reserve(fields.num_values());
+        }
+        fields.for_each_value(|points| {
+            let date = points.child(&name::DATE).and_then(|date| date.date());
+            let value = match date {
+                Some(date) if serie.dates.len() == serie.values.len() => serie.entry(date),
+                _ => {
+                    serie.dates.extend(date);
+                    serie.values.push(R::default());
+                    serie.values.last_mut().unwrap()
                 }
-                if is_empty {
-                    break;
+            };
+            points.for_each_element(|field_name, field| {
+                if *field_name != *name::DATE {
+                    field.set_field(field_name, value);
                 }
+            });
+        });
+    }
+}
 
-                // add fields
-                for field in fields {
-                    request.append_named(&name::FIELDS_NAME, *field)?;
-                }
+/// Decode a `ReferenceDataRequest` response event into `ref_data`
+///
+/// Securities in error are skipped and their error pushed into `errors`.
+pub(crate) fn ref_data_event<R: RefData>(
+    event: &Event,
+    ref_data: &mut HashMap<String, R>,
+    errors: &mut Vec<Error>,
+) {
+    for message in event.messages() {
+        ref_data_message(&message.element(), ref_data, errors);
+    }
+}
 
-                options.apply(&mut request)?;
-
-                // send request
-                for event in self.send(request, None)? {
-                    for message in event?.messages().map(|m| m.element()) {
-                        if let Some(security) = message.get_named_element(&name::SECURITY_DATA) {
-                            let ticker = security
-                                .get_named_element(&name::SECURITY_NAME)
-                                .and_then(|s| s.get_at(0))
-                                .unwrap_or_else(|| String::new());
-                            if security.has_named_element(&name::SECURITY_ERROR) {
-                                break;
-                            }
-                            if let Some(fields) = security.get_named_element(&name::FIELD_DATA) {
-                                let entry = ref_data.entry(ticker).or_insert_with(|| {
-                                    let len = fields.num_values();
-                                    TimeSerie::<_>::with_capacity(len)
-                                });
-                                for points in fields.values::<Element>() {
-                                    let mut value = R::default();
-                                    for field in points.elements() {
-                                        let name = &field.string_name();
-                                        if name == "date" {
-                                            #[cfg(feature = "dates")]
-                                            entry
-                                                .dates
-                                                .extend(field.get_at::<chrono::NaiveDate>(0));
-                                            #[cfg(not(feature = "dates"))]
-                                            entry.dates.extend(field.get_at(0));
-                                        } else {
-                                            value.on_field(name, &field);
-                                        }
-                                    }
-                                    entry.values.push(value);
-                                }
-                            }
-                        }
-                    }
+/// Decode a `ReferenceDataRequest` response message into `ref_data`
+pub(crate) fn ref_data_message<R: RefData, T: Tree>(
+    message: &T,
+    ref_data: &mut HashMap<String, R>,
+    errors: &mut Vec<Error>,
+) {
+    if let Some(securities) = message.child(&name::SECURITY_DATA) {
+        securities.for_each_value(|security| match security_ticker(&security) {
+            Ok(ticker) => decode_fields(&security, ref_data.entry(ticker).or_default()),
+            Err(e) => errors.push(e),
+        });
+    }
+}
+
+/// Decode a `HistoricalDataRequest` response event into `ref_data`
+///
+/// Securities in error are skipped and their error pushed into `errors`.
+pub(crate) fn hist_data_event<R: RefData>(
+    event: &Event,
+    ref_data: &mut HashMap<String, TimeSerie<R>>,
+    errors: &mut Vec<Error>,
+) {
+    for message in event.messages() {
+        hist_data_message(&message.element(), ref_data, errors);
+    }
+}
+
+/// Decode a `HistoricalDataRequest` response message into `ref_data`
+pub(crate) fn hist_data_message<R: RefData, T: Tree>(
+    message: &T,
+    ref_data: &mut HashMap<String, TimeSerie<R>>,
+    errors: &mut Vec<Error>,
+) {
+    if let Some(security) = message.child(&name::SECURITY_DATA) {
+        match security_ticker(&security) {
+            Ok(ticker) => {
+                if security.child(&name::FIELD_DATA).is_some() {
+                    decode_points(&security, ref_data.entry(ticker).or_default())
                 }
             }
+            Err(e) => errors.push(e),
         }
-        Ok(ref_data)
     }
 }
 
 impl std::ops::Deref for SessionSync {
     type Target = Session;
     fn deref(&self) -> &Session {
-        &self.0
+        &self.session
     }
 }
 
 impl std::ops::DerefMut for SessionSync {
     fn deref_mut(&mut self) -> &mut Session {
-        &mut self.0
+        &mut self.session
+    }
+}
+
+impl EventSource for SessionSync {
+    fn next_event(&mut self, timeout_ms: Option<u32>) -> Result<Event, Error> {
+        let event = self.session.next_event(timeout_ms)?;
+        if let Some(recording) = self.recording.as_mut() {
+            recording.push(event.clone());
+        }
+        Ok(event)
     }
 }
 
-/// An iterator over messages
+/// An iterator over the events of a request, up to its final `Response`
 pub struct Events<'a> {
-    session: &'a mut SessionSync,
+    session: &'a mut dyn EventSource,
     exit: bool,
 }
 
 impl<'a> Events<'a> {
-    fn new(session: &'a mut SessionSync) -> Self {
+    /// Create a new iterator over the next request events of `source`
+    pub fn new(source: &'a mut dyn EventSource) -> Self {
         Events {
-            session,
+            session: source,
             exit: false,
         }
     }
@@ -398,7 +808,7 @@ impl<'a> Iterator for Events<'a> {
 }
 
 /// Options for historical data request
-#[derive(Debug, Default)]
+#[derive(Debug, Default, Clone)]
 pub struct HistOptions {
     /// Start date yyyyMMdd
     start_date: String,
@@ -454,32 +864,123 @@ impl HistOptions {
         self
     }
 
-    fn apply(&self, request: &mut Request) -> Result<(), Error> {
+    /// Start and end dates, in days since 1970-01-01, if valid yyyyMMdd dates
+    pub(crate) fn days(&self) -> Option<(i32, i32)> {
+        let days = |date: &str| -> Option<i32> {
+            let y = date.get(0..4)?.parse().ok()?;
+            let m = date.get(4..6)?.parse().ok()?;
+            let d = date.get(6..8)?.parse().ok()?;
+            Some(days_from_civil(y, m, d))
+        };
+        Some((days(&self.start_date)?, days(&self.end_date)?))
+    }
+
+    /// Same options, between other dates (days since 1970-01-01)
+    pub(crate) fn between(&self, start: i32, end: i32) -> Self {
+        let date = |days| {
+            let (y, m, d) = civil_from_days(days);
+            format!("{:04}{:02}{:02}", y, m, d)
+        };
+        HistOptions {
+            start_date: date(start),
+            end_date: date(end),
+            ..self.clone()
+        }
+    }
+
+    /// Options which change the values, but not the dates, of the response
+    ///
+    /// `None` if the points may not cover the whole date range (`max_data_points`)
+    pub(crate) fn values_key(&self) -> Option<String> {
+        if self.max_data_points.is_some() {
+            return None;
+        }
+        Some(format!(
+            "{}/{}/{}",
+            self.periodicity_selection.map_or("", |p| p.as_str()),
+            self.periodicity_adjustment.map_or("", |p| p.as_str()),
+            self.currency.as_ref().map_or("", |c| &**c),
+        ))
+    }
+
+    /// Estimated number of points per security and field, used to size requests
+    #[cfg(feature = "async")]
+    pub(crate) fn points(&self) -> usize {
+        let days = match self.days() {
+            Some((start, end)) => (end - start + 1).max(1) as usize,
+            None => 1,
+        };
+        let period = match self.periodicity_selection {
+            None | Some(PeriodicitySelection::Daily) => 1,
+            Some(PeriodicitySelection::Weekly) => 7,
+            Some(PeriodicitySelection::Monthly) => 30,
+            Some(PeriodicitySelection::Quarterly) => 91,
+            Some(PeriodicitySelection::SemiAnnually) => 182,
+            Some(PeriodicitySelection::Yearly) => 365,
+        };
+        let points = (days / period).max(1);
+        match self.max_data_points {
+            Some(max) if max > 0 => points.min(max as usize),
+            _ => points,
+        }
+    }
+
+    pub(crate) fn apply(&self, request: &mut Request) -> Result<(), Error> {
         let mut element = request.element();
-        element.set("startDate", &self.start_date[..])?;
-        element.set("endDate", &self.end_date[..])?;
+        element.set_named(&name::START_DATE, &self.start_date[..])?;
+        element.set_named(&name::END_DATE, &self.end_date[..])?;
         if let Some(periodicity_selection) = self.periodicity_selection {
-            element.set("periodicitySelection", periodicity_selection.as_str())?;
+            element.set_named(&name::PERIODICITY_SELECTION, periodicity_selection.as_str())?;
         }
         if let Some(periodicity_adjustment) = self.periodicity_adjustment {
-            element.set("periodicityAdjustment", periodicity_adjustment.as_str())?;
+            element.set_named(
+                &name::PERIODICITY_ADJUSTMENT,
+                periodicity_adjustment.as_str(),
+            )?;
         }
         if let Some(max_data_points) = self.max_data_points {
-            element.set("maxDataPoints", max_data_points)?;
+            element.set_named(&name::MAX_DATA_POINTS, max_data_points)?;
         }
         if let Some(currency) = self.currency.as_ref() {
-            element.set("currency", &**currency)?;
+            element.set_named(&name::CURRENCY, &**currency)?;
         }
         Ok(())
     }
 }
 
+#[cfg(feature = "dates")]
+pub(crate) type Date = chrono::NaiveDate;
+#[cfg(not(feature = "dates"))]
+pub(crate) type Date = crate::datetime::Datetime;
+
+/// Days since 1970-01-01
+#[cfg(feature = "dates")]
+fn days_since_epoch(date: &Date) -> i32 {
+    use chrono::Datelike;
+    date.num_days_from_ce() - 719_163
+}
+
+/// Days since 1970-01-01
+#[cfg(not(feature = "dates"))]
+fn days_since_epoch(date: &Date) -> i32 {
+    date.days_since_epoch()
+}
+
+/// Date from days since 1970-01-01
+#[cfg(feature = "dates")]
+pub(crate) fn date_from_days(days: i32) -> Option<Date> {
+    chrono::NaiveDate::from_num_days_from_ce_opt(days + 719_163)
+}
+
+/// Date from days since 1970-01-01
+#[cfg(not(feature = "dates"))]
+pub(crate) fn date_from_days(days: i32) -> Option<Date> {
+    Some(crate::datetime::Datetime::from_days_since_epoch(days))
+}
+
 #[derive(Default, Debug)]
 pub struct TimeSerie<R> {
-    #[cfg(feature = "dates")]
-    pub dates: Vec<chrono::NaiveDate>,
-    #[cfg(not(feature = "dates"))]
-    pub dates: Vec<crate::datetime::Datetime>,
+    pub dates: Vec<Date>,
     pub values: Vec<R>,
 }
 
@@ -491,6 +992,31 @@ impl<R> TimeSerie<R> {
             values: Vec::with_capacity(capacity),
         }
     }
+
+    /// Get the value at `date`, inserted at its position if missing
+    ///
+    /// Dates are kept sorted, appending a later date is the fast path.
+    pub(crate) fn entry(&mut self, date: Date) -> &mut R
+    where
+        R: Default,
+    {
+        let day = days_since_epoch(&date);
+        let position = match self.dates.last() {
+            Some(last) if days_since_epoch(last) >= day => {
+                self.dates.binary_search_by_key(&day, days_since_epoch)
+            }
+            _ => Err(self.dates.len()),
+        };
+        let i = match position {
+            Ok(i) => i,
+            Err(i) => {
+                self.dates.insert(i, date);
+                self.values.insert(i, R::default());
+                i
+            }
+        };
+        &mut self.values[i]
+    }
 }
 
 /// Periodicity Adjustment
@@ -541,6 +1067,77 @@ impl PeriodicitySelection {
 mod tests {
     use super::*;
 
+    #[test]
+    #[cfg(feature = "async")]
+    fn hist_points() {
+        let options = HistOptions::new("20190101", "20191231");
+        assert_eq!(options.points(), 365);
+        let options = options.with_periodicity_selection(PeriodicitySelection::Monthly);
+        assert_eq!(options.points(), 12);
+        assert_eq!(HistOptions::new("2019", "").points(), 1);
+    }
+
+    #[test]
+    fn hist_between() {
+        let options = HistOptions::new("20190101", "20191231");
+        let options = options.between(17_897, 17_927);
+        assert_eq!(
+            (&*options.start_date, &*options.end_date),
+            ("20190101", "20190131")
+        );
+    }
+
+    /// A security with more fields than a single historical request
+    #[derive(Default)]
+    struct Wide(Vec<Option<f64>>);
+
+    impl RefData for Wide {
+        const FIELDS: &'static [&'static str] = &[
+            "F00", "F01", "F02", "F03", "F04", "F05", "F06", "F07", "F08", "F09", "F10", "F11",
+            "F12", "F13", "F14", "F15", "F16", "F17", "F18", "F19", "F20", "F21", "F22", "F23",
+            "F24", "F25", "F26", "F27", "F28", "F29",
+        ];
+        fn on_field(&mut self, _field: &str, _element: &Element) {}
+        fn on_value(&mut self, field: &str, value: &crate::value::Value) -> bool {
+            let i = Self::FIELDS.iter().position(|f| *f == field).unwrap();
+            self.0.resize(Self::FIELDS.len(), None);
+            if let crate::value::Value::Float(value) = value {
+                self.0[i] = Some(*value);
+            }
+            true
+        }
+    }
+
+    #[test]
+    fn hist_merge_chunks() {
+        let date = |day: u32| {
+            #[cfg(feature = "dates")]
+            return chrono::NaiveDate::from_ymd_opt(2019, 1, day).unwrap();
+            #[cfg(not(feature = "dates"))]
+            return crate::datetime::Datetime::from_ymd(2019, 1, day as u8);
+        };
+
+        // the second chunk misses a date and has a new one in between
+        let chunks = Wide::FIELDS.chunks(MAX_HISTDATA_FIELDS).collect::<Vec<_>>();
+        assert_eq!(chunks.len(), 2);
+        let mut serie = TimeSerie::<Wide>::default();
+        for (chunk, days) in chunks.iter().zip(&[&[2, 4, 7][..], &[2, 3, 7]]) {
+            for day in *days {
+                let value = serie.entry(date(*day));
+                for field in *chunk {
+                    value.on_value(field, &crate::value::Value::Float(*day as f64));
+                }
+            }
+        }
+
+        let days = serie.dates.iter().map(days_since_epoch).collect::<Vec<_>>();
+        let first = days_since_epoch(&date(1)) - 1;
+        assert_eq!(days, vec![first + 2, first + 3, first + 4, first + 7]);
+        let set = |i: usize| serie.values[i].0.iter().filter(|v| v.is_some()).count();
+        assert_eq!((set(0), set(1), set(2), set(3)), (30, 5, 25, 30));
+        assert_eq!(serie.values[3].0[29], Some(7.));
+    }
+
     #[test]
     fn send_request() -> Result<(), Error> {
         let mut session = SessionOptions::default()
@@ -0,0 +1,392 @@
+use crate::{
+    event::{Event, EventType},
+    message::Message,
+    name,
+    ref_data::RefData,
+    request::Request,
+    session::{self, HistOptions, Session, SessionSync, TimeSerie},
+    subscription::{Dispatch, Registry, Subscription, SubscriptionOptions},
+    Error,
+};
+use futures::{
+    channel::mpsc::{self, UnboundedReceiver, UnboundedSender},
+    stream::{self, Stream, StreamExt},
+    task::{Context, Poll},
+};
+use std::collections::HashMap;
+use std::pin::Pin;
+use std::sync::{
+    atomic::{AtomicBool, Ordering},
+    Arc, Mutex,
+};
+use std::thread::{self, JoinHandle};
+
+/// Maximum time the pump thread waits on `nextEvent` before checking if it must stop
+const PUMP_TIMEOUT_MS: u32 = 100;
+
+/// In-flight requests, by correlation id
+type Pending = Arc<Mutex<HashMap<u64, UnboundedSender<Result<Event, Error>>>>>;
+
+/// A session which can keep many requests in flight at once
+///
+/// A background thread pumps the session events and routes each response to
+/// the `Responses` stream of the request it belongs to, using its `CorrelationId`.
+/// Subscription data are decoded on the same thread and published to the
+/// subscription consumers.
+///
+/// Request failures and the termination of the session are yielded as `Err`
+/// by the responses of the requests they belong to. Once the session is
+/// terminated or failing, the pump stops and no new request can be sent.
+pub struct SessionAsync {
+    session: Arc<Session>,
+    pending: Pending,
+    subscriptions: Registry,
+    /// Set to stop the pump, on drop or once the session is dead
+    stop: Arc<AtomicBool>,
+    pump: Option<JoinHandle<()>>,
+}
+
+impl SessionAsync {
+    /// Create a new `SessionAsync` with default options and open refdata service
+    pub fn new() -> Result<Self, Error> {
+        Ok(SessionAsync::from_sync(SessionSync::new()?))
+    }
+
+    /// Create a new `SessionAsync` from an already started `SessionSync`
+    ///
+    /// Services must be opened beforehand.
+    pub fn from_sync(session: SessionSync) -> Self {
+        let session = Arc::new(session.session);
+        let pending = Pending::default();
+        let subscriptions = Registry::default();
+        let stop = Arc::new(AtomicBool::new(false));
+        let pump = {
+            let session = session.clone();
+            let pending = pending.clone();
+            let subscriptions = subscriptions.clone();
+            let stop = stop.clone();
+            thread::spawn(move || pump(&session, &pending, &subscriptions, &stop))
+        };
+        SessionAsync {
+            session,
+            pending,
+            subscriptions,
+            stop,
+            pump: Some(pump),
+        }
+    }
+
+    /// Send request and get a stream of its response events
+    ///
+    /// The stream ends once the final `Response` has been received, or after
+    /// an `Err` if the request failed or the session terminated.
+    pub fn send(&self, request: Request) -> Result<Responses, Error> {
+        let correlation_id = self.session.new_correlation_id();
+        let id = correlation_id.value_u64().unwrap_or_default();
+        let (tx, rx) = mpsc::unbounded();
+
+        // register before sending so no response can be missed, and check the
+        // pump afterwards: once stopped, it won't fail this request anymore
+        self.pending.lock().unwrap().insert(id, tx);
+        if self.stop.load(Ordering::SeqCst) {
+            self.pending.lock().unwrap().remove(&id);
+            return Err(Error::SessionTerminated);
+        }
+        if let Err(e) = self.session.send(request, Some(correlation_id)) {
+            self.pending.lock().unwrap().remove(&id);
+            return Err(e);
+        }
+        Ok(Responses(rx))
+    }
+
+    /// Get reference data for `RefData` items
+    ///
+    /// All the requests are sent upfront and their responses are decoded as
+    /// they arrive.
+    ///
+    /// # Example
+    ///
+    /// ```
+    /// # #[cfg(all(feature = "derive", feature = "async"))]
+    /// # {
+    /// use blpapi::{RefData, session_async::SessionAsync};
+    ///
+    /// #[derive(Default, RefData)]
+    /// struct EquityData {
+    ///     ticker: String,
+    ///     crncy: String,
+    /// }
+    ///
+    /// let session = SessionAsync::new().unwrap();
+    /// let securities: &[&str] = &[ /* list of security tickers */ ];
+    ///
+    /// let equities = futures::executor::block_on(session.ref_data::<_, EquityData>(securities));
+    /// # }
+    /// ```
+    pub async fn ref_data<I, R>(&self, securities: I) -> Result<HashMap<String, R>, Error>
+    where
+        I: IntoIterator,
+        I::Item: AsRef<str>,
+        R: RefData,
+    {
+        let securities: Vec<I::Item> = securities.into_iter().collect();
+        let responses = self.send_all("ReferenceDataRequest", &securities, R::FIELDS, None)?;
+
+        let mut ref_data = HashMap::new();
+        let mut errors = Vec::new();
+        let mut events = stream::select_all(responses);
+        while let Some(event) = events.next().await {
+            session::ref_data_event(&event?, &mut ref_data, &mut errors);
+            if let Some(error) = errors.pop() {
+                return Err(error);
+            }
+        }
+        Ok(ref_data)
+    }
+
+    /// Get historical data
+    ///
+    /// All the requests are sent upfront and their responses are decoded as
+    /// they arrive.
+    pub async fn hist_data<I, R>(
+        &self,
+        securities: I,
+        options: HistOptions,
+    ) -> Result<HashMap<String, TimeSerie<R>>, Error>
+    where
+        I: IntoIterator,
+        I::Item: AsRef<str>,
+        R: RefData,
+    {
+        let securities: Vec<I::Item> = securities.into_iter().collect();
+        let responses = self.send_all(
+            "HistoricalDataRequest",
+            &securities,
+            R::FIELDS,
+            Some(&options),
+        )?;
+
+        let mut ref_data = HashMap::new();
+        let mut errors = Vec::new();
+        let mut events = stream::select_all(responses);
+        while let Some(event) = events.next().await {
+            session::hist_data_event(&event?, &mut ref_data, &mut errors);
+            if let Some(error) = errors.pop() {
+                return Err(error);
+            }
+        }
+        Ok(ref_data)
+    }
+
+    /// Subscribe to real-time `RefData` updates of topics
+    ///
+    /// Ticks are decoded on the pump thread and published to every consumer
+    /// without ever blocking: a lagging consumer either drops ticks or, when
+    /// conflating, only sees the latest value of each topic. Topics failing
+    /// or terminated by bloomberg are reported to every consumer too.
+    ///
+    /// # Example
+    ///
+    /// ```
+    /// # #[cfg(all(feature = "derive", feature = "async"))]
+    /// # {
+    /// use blpapi::{RefData, session_async::SessionAsync, subscription::SubscriptionOptions};
+    ///
+    /// #[derive(Default, Clone, RefData)]
+    /// struct Quote {
+    ///     bid: Option<f64>,
+    ///     ask: Option<f64>,
+    /// }
+    ///
+    /// let session = SessionAsync::new().unwrap();
+    /// session.open_service("//blp/mktdata").unwrap();
+    /// let topics: &[&str] = &[ /* list of security tickers */ ];
+    ///
+    /// let options = SubscriptionOptions::default().with_conflation(true);
+    /// let mut subscription = session.subscribe::<_, Quote>(topics, options).unwrap();
+    /// for mut consumer in subscription.take_consumers() {
+    ///     std::thread::spawn(move || loop {
+    ///         for tick in consumer.try_iter() { /* ... */ }
+    ///         while let Some(failure) = consumer.try_recv_failure() { /* ... */ }
+    ///         std::thread::yield_now();
+    ///     });
+    /// }
+    /// # }
+    /// ```
+    pub fn subscribe<I, R>(
+        &self,
+        topics: I,
+        options: SubscriptionOptions,
+    ) -> Result<Subscription<R>, Error>
+    where
+        I: IntoIterator,
+        I::Item: AsRef<str>,
+        R: RefData + Clone + Send + 'static,
+    {
+        let topics = topics.into_iter().map(|t| t.as_ref().to_owned()).collect();
+        Subscription::new(&self.session, &self.subscriptions, topics, options)
+    }
+
+    /// Send as many `ReferenceDataRequest` (no `options`) or `HistoricalDataRequest`
+    /// as necessary for securities x fields
+    fn send_all<S: AsRef<str>>(
+        &self,
+        operation: &str,
+        securities: &[S],
+        fields: &[&str],
+        options: Option<&HistOptions>,
+    ) -> Result<Vec<Responses>, Error> {
+        self.session
+            .create_requests(operation, securities, fields, options)?
+            .into_iter()
+            .map(|request| self.send(request))
+            .collect()
+    }
+}
+
+impl std::ops::Deref for SessionAsync {
+    type Target = Session;
+    fn deref(&self) -> &Session {
+        &self.session
+    }
+}
+
+impl Drop for SessionAsync {
+    fn drop(&mut self) {
+        self.stop.store(true, Ordering::SeqCst);
+        if let Some(pump) = self.pump.take() {
+            let _ = pump.join();
+        }
+    }
+}
+
+/// Pull all session events and route responses to their pending request
+/// and subscription data to their subscription
+///
+/// Stops when the session terminates or fails, failing all the pending requests.
+fn pump(session: &Session, pending: &Pending, subscriptions: &Registry, stop: &AtomicBool) {
+    while !stop.load(Ordering::SeqCst) {
+        let event = match session.next_event(Some(PUMP_TIMEOUT_MS)) {
+            Ok(event) => event,
+            Err(e) => {
+                log::error!("cannot get next event, stopping: {}", e);
+                fail_all(pending, stop);
+                return;
+            }
+        };
+        match event.event_type() {
+            EventType::PartialResponse => route(pending, request_id(&event), Ok(event), false),
+            EventType::Response => route(pending, request_id(&event), Ok(event), true),
+            EventType::RequestStatus => {
+                for message in event.messages() {
+                    let id = message.correlation_id(0).and_then(|id| id.value_u64());
+                    let error = if message.message_type() == *name::REQUEST_FAILURE {
+                        let reason = message.element().get_named_element(&name::REASON);
+                        reason.map_or(Error::NotFound("reason".into()), Error::request)
+                    } else {
+                        Error::Request {
+                            category: message.message_type().to_string(),
+                            message: String::new(),
+                        }
+                    };
+                    route(pending, id, Err(error), true);
+                }
+            }
+            EventType::SubscriptionData => {
+                for message in event.messages() {
+                    dispatch(subscriptions, &message, |d, topic, m| {
+                        d.on_message(topic, m)
+                    });
+                }
+            }
+            EventType::SubscriptionStatus => {
+                for message in event.messages() {
+                    let message_type = message.message_type();
+                    if message_type == *name::SUBSCRIPTION_FAILURE
+                        || message_type == *name::SUBSCRIPTION_TERMINATED
+                    {
+                        dispatch(subscriptions, &message, |d, topic, m| {
+                            d.on_failure(topic, m)
+                        });
+                    }
+                }
+            }
+            EventType::SessionStatus => {
+                if event
+                    .messages()
+                    .map(|m| m.message_type())
+                    .any(|m| m == *name::SESSION_TERMINATED || m == *name::SESSION_STARTUP_FAILURE)
+                {
+                    fail_all(pending, stop);
+                    return;
+                }
+            }
+            _ => (),
+        }
+    }
+}
+
+/// Call `f` on the dispatcher of each subscribed topic `message` belongs to
+fn dispatch<F>(subscriptions: &Registry, message: &Message, f: F)
+where
+    F: Fn(&dyn Dispatch, usize, &Message),
+{
+    let subscriptions = subscriptions.lock().unwrap();
+    for i in 0..message.num_correlation_ids() {
+        let id = message.correlation_id(i).and_then(|id| id.value_u64());
+        match id.and_then(|id| subscriptions.get(&id)) {
+            Some((dispatcher, topic)) => f(&**dispatcher, *topic, message),
+            None => log::debug!("dropping message for unknown subscription"),
+        }
+    }
+}
+
+/// Stop the pump and end all the pending requests with an error
+fn fail_all(pending: &Pending, stop: &AtomicBool) {
+    // stop first, `send` checks it after registering its request
+    stop.store(true, Ordering::SeqCst);
+    for (_, sender) in pending.lock().unwrap().drain() {
+        let _ = sender.unbounded_send(Err(Error::SessionTerminated));
+    }
+}
+
+/// Correlation id of the request an event belongs to
+fn request_id(event: &Event) -> Option<u64> {
+    event
+        .messages()
+        .next()
+        .and_then(|m| m.correlation_id(0))
+        .and_then(|id| id.value_u64())
+}
+
+/// Send an item to the request it belongs to, closing its stream if it is the last one
+fn route(pending: &Pending, id: Option<u64>, item: Result<Event, Error>, last: bool) {
+    let id = match id {
+        Some(id) => id,
+        None => return,
+    };
+    let mut pending = pending.lock().unwrap();
+    let sender = if last {
+        pending.remove(&id)
+    } else {
+        pending.get(&id).cloned()
+    };
+    match sender {
+        Some(sender) => {
+            let _ = sender.unbounded_send(item);
+        }
+        None => log::debug!("dropping event for unknown request {}", id),
+    }
+}
+
+/// A stream over the response events of a request
+///
+/// A failure of the request, or of the session, is its last item.
+pub struct Responses(UnboundedReceiver<Result<Event, Error>>);
+
+impl Stream for Responses {
+    type Item = Result<Event, Error>;
+    fn poll_next(mut self: Pin<&mut Self>, cx: &mut Context) -> Poll<Option<Result<Event, Error>>> {
+        self.0.poll_next_unpin(cx)
+    }
+}
@@ -72,6 +72,19 @@ impl SessionOptions {
         Ok(self)
     }
 
+    /// Get max event queue size
+    pub fn max_event_queue_size(&self) -> usize {
+        unsafe { blpapi_SessionOptions_maxEventQueueSize(self.0) }
+    }
+
+    /// Set max event queue size
+    ///
+    /// Once reached, incoming subscription data are dropped
+    pub fn with_max_event_queue_size(self, size: usize) -> Self {
+        unsafe { blpapi_SessionOptions_setMaxEventQueueSize(self.0, size) };
+        self
+    }
+
     /// Build a session, transfer ownership
     pub fn sync(self) -> SessionSync {
         SessionSync::from_options(self)
@@ -0,0 +1,351 @@
+//! Streaming requests, with bounded memory
+//!
+//! A `Stream` yields decoded items (a security, a time serie, a bar ...) as
+//! soon as the `PartialResponse` event holding them is received, instead of
+//! accumulating the whole result.
+//!
+//! Events are only pulled from the session when all the items of the previous
+//! event have been consumed, and the requests are sent one at a time, once the
+//! previous one is complete: a slow consumer stops the stream, and at most one
+//! event worth of items is kept in memory.
+//!
+//! Items can also be pushed to a `Sink` (a closure, a bounded channel, a
+//! `Csv` writer ...) with `Stream::forward`. The sink applies backpressure by
+//! blocking until it is ready for the next item.
+
+use crate::{
+    datetime::Datetime,
+    element::Element,
+    event::{Event, EventType},
+    intraday::{Bar, Tick},
+    name,
+    ref_data::RefData,
+    request::Request,
+    session::{self, Events, SessionSync, TimeSerie},
+    Error,
+};
+use std::collections::VecDeque;
+use std::io::{self, Write};
+use std::sync::mpsc::SyncSender;
+
+type Requests<'a> = Box<dyn Iterator<Item = Result<Request, Error>> + 'a>;
+type Decode<'a, T> = Box<dyn FnMut(&Event, &mut VecDeque<Result<T, Error>>) + 'a>;
+
+/// An iterator over the items of a sequence of requests
+///
+/// Errors of a single security are yielded as `Err` items and don't stop the
+/// stream. Any other error ends it.
+///
+/// A stream dropped, or ended by an error, before the end of the request in
+/// flight reads and discards its remaining events, so that they are never
+/// taken for the response of the next request of the session.
+pub struct Stream<'a, T> {
+    session: &'a mut SessionSync,
+    /// Requests not sent yet
+    requests: Requests<'a>,
+    decode: Decode<'a, T>,
+    /// Decoded items of the last event
+    items: VecDeque<Result<T, Error>>,
+    /// A request has been sent and its final `Response` is not received yet
+    pending: bool,
+}
+
+impl<'a, T> Stream<'a, T> {
+    /// Create a new stream, sending `requests` one at a time and decoding
+    /// their response events with `decode`
+    pub(crate) fn new<R, D>(session: &'a mut SessionSync, requests: R, decode: D) -> Self
+    where
+        R: Iterator<Item = Result<Request, Error>> + 'a,
+        D: FnMut(&Event, &mut VecDeque<Result<T, Error>>) + 'a,
+    {
+        Stream {
+            session,
+            requests: Box::new(requests),
+            decode: Box::new(decode),
+            items: VecDeque::new(),
+            pending: false,
+        }
+    }
+
+    /// Send all the items to `sink`
+    ///
+    /// Returns the errors of securities, which don't stop the stream, or the
+    /// first other error (including the sink ones).
+    pub fn forward<S: Sink<T>>(self, mut sink: S) -> Result<Vec<Error>, Error> {
+        let mut errors = Vec::new();
+        for item in self {
+            match item {
+                Ok(item) => sink.send(item)?,
+                Err(e @ Error::Security { .. }) => errors.push(e),
+                Err(e) => return Err(e),
+            }
+        }
+        sink.flush()?;
+        Ok(errors)
+    }
+
+    /// Get the next response event, sending the next request if necessary
+    fn next_event(&mut self) -> Result<Option<Event>, Error> {
+        if !self.pending {
+            match self.requests.next() {
+                Some(request) => {
+                    self.session.send(request?, None)?;
+                    self.pending = true;
+                }
+                None => return Ok(None),
+            }
+        }
+        match Events::new(&mut *self.session).next() {
+            Some(Ok(event)) => {
+                if let EventType::Response = event.event_type() {
+                    self.pending = false;
+                }
+                Ok(Some(event))
+            }
+            Some(Err(e)) => Err(e),
+            // session terminated
+            None => {
+                self.pending = false;
+                Ok(None)
+            }
+        }
+    }
+
+    /// Discard the remaining events of the request in flight
+    fn drain(&mut self) {
+        while self.pending {
+            match Events::new(&mut *self.session).next() {
+                Some(Ok(event)) => {
+                    if let EventType::Response = event.event_type() {
+                        self.pending = false;
+                    }
+                }
+                // session terminated or failing, nothing left to read
+                Some(Err(_)) | None => self.pending = false,
+            }
+        }
+    }
+}
+
+impl<'a, T> Drop for Stream<'a, T> {
+    fn drop(&mut self) {
+        self.drain();
+    }
+}
+
+impl<'a, T> Iterator for Stream<'a, T> {
+    type Item = Result<T, Error>;
+    fn next(&mut self) -> Option<Result<T, Error>> {
+        loop {
+            if let Some(item) = self.items.pop_front() {
+                return Some(item);
+            }
+            match self.next_event() {
+                Ok(Some(event)) => (self.decode)(&event, &mut self.items),
+                Ok(None) => {
+                    self.requests = Box::new(std::iter::empty());
+                    return None;
+                }
+                Err(e) => {
+                    self.requests = Box::new(std::iter::empty());
+                    self.drain();
+                    return Some(Err(e));
+                }
+            }
+        }
+    }
+}
+
+/// A consumer of streamed items
+pub trait Sink<T> {
+    /// Consume an item, blocking until the consumer is ready for it
+    fn send(&mut self, item: T) -> Result<(), Error>;
+
+    /// Flush any buffered item, once the stream is over
+    fn flush(&mut self) -> Result<(), Error> {
+        Ok(())
+    }
+}
+
+impl<T, F: FnMut(T) -> Result<(), Error>> Sink<T> for F {
+    fn send(&mut self, item: T) -> Result<(), Error> {
+        self(item)
+    }
+}
+
+/// A bounded channel, blocking the stream while it is full
+impl<T> Sink<T> for SyncSender<T> {
+    fn send(&mut self, item: T) -> Result<(), Error> {
+        SyncSender::send(self, item).map_err(|_| io::Error::from(io::ErrorKind::BrokenPipe).into())
+    }
+}
+
+/// A sink writing bars or ticks as csv lines, without header
+///
+/// - bars: `time,open,high,low,close,volume,num_events,value`
+/// - ticks: `time,type,value,size,condition_codes`
+///
+/// Times are written as `yyyy-mm-ddThh:mm:ss.mmm`, strings are quoted when
+/// needed. Lines are written to the
+/// writer as they come: wrap it in a `BufWriter` if needed.
+pub struct Csv<W> {
+    writer: W,
+}
+
+impl<W: Write> Csv<W> {
+    /// Create a new csv sink
+    pub fn new(writer: W) -> Self {
+        Csv { writer }
+    }
+
+    /// Get the underlying writer
+    pub fn into_inner(self) -> W {
+        self.writer
+    }
+}
+
+impl<W: Write> Sink<Bar> for Csv<W> {
+    fn send(&mut self, bar: Bar) -> Result<(), Error> {
+        writeln!(
+            self.writer,
+            "{},{},{},{},{},{},{},{}",
+            Iso(&bar.time),
+            bar.open,
+            bar.high,
+            bar.low,
+            bar.close,
+            bar.volume,
+            bar.num_events,
+            bar.value
+        )?;
+        Ok(())
+    }
+
+    fn flush(&mut self) -> Result<(), Error> {
+        Ok(self.writer.flush()?)
+    }
+}
+
+impl<W: Write> Sink<Tick> for Csv<W> {
+    fn send(&mut self, tick: Tick) -> Result<(), Error> {
+        write!(self.writer, "{},", Iso(&tick.time))?;
+        write_field(&mut self.writer, tick.event_type.to_bytes())?;
+        write!(self.writer, ",{},{},", tick.value, tick.size)?;
+        let condition_codes = tick.condition_codes.as_ref().map_or("", |c| &**c);
+        write_field(&mut self.writer, condition_codes.as_bytes())?;
+        writeln!(self.writer)?;
+        Ok(())
+    }
+
+    fn flush(&mut self) -> Result<(), Error> {
+        Ok(self.writer.flush()?)
+    }
+}
+
+/// Write a csv string field, quoted if it contains a separator, a quote or
+/// a new line (e.g. condition codes), with its quotes doubled
+fn write_field<W: Write>(writer: &mut W, field: &[u8]) -> io::Result<()> {
+    if !field
+        .iter()
+        .any(|b| matches!(b, b',' | b'"' | b'\n' | b'\r'))
+    {
+        return writer.write_all(field);
+    }
+    writer.write_all(b"\"")?;
+    for (i, part) in field.split(|b| *b == b'"').enumerate() {
+        if i > 0 {
+            writer.write_all(b"\"\"")?;
+        }
+        writer.write_all(part)?;
+    }
+    writer.write_all(b"\"")
+}
+
+/// Display a datetime as `yyyy-mm-ddThh:mm:ss.mmm`
+struct Iso<'a>(&'a Datetime);
+
+impl<'a> std::fmt::Display for Iso<'a> {
+    fn fmt(&self, f: &mut std::fmt::Formatter) -> std::fmt::Result {
+        let d = (self.0).0;
+        write!(
+            f,
+            "{:04}-{:02}-{:02}T{:02}:{:02}:{:02}.{:03}",
+            d.year, d.month, d.day, d.hours, d.minutes, d.seconds, d.milliSeconds
+        )
+    }
+}
+
+/// Decode a `ReferenceDataRequest` response event, one item per security
+pub(crate) fn ref_data_event<R: RefData>(
+    event: &Event,
+    items: &mut VecDeque<Result<(String, R), Error>>,
+) {
+    for message in event.messages().map(|m| m.element()) {
+        if let Some(securities) = message.get_named_element(&name::SECURITY_DATA) {
+            for security in securities.values::<Element>() {
+                items.push_back(session::security_ticker(&security).map(|ticker| {
+                    let mut value = R::default();
+                    session::decode_fields(&security, &mut value);
+                    (ticker, value)
+                }));
+            }
+        }
+    }
+}
+
+/// Decode a `HistoricalDataRequest` response event, one item per security
+pub(crate) fn hist_data_event<R: RefData>(
+    event: &Event,
+    items: &mut VecDeque<Result<(String, TimeSerie<R>), Error>>,
+) {
+    for message in event.messages().map(|m| m.element()) {
+        if let Some(security) = message.get_named_element(&name::SECURITY_DATA) {
+            items.push_back(session::security_ticker(&security).map(|ticker| {
+                let mut serie = TimeSerie::default();
+                session::decode_points(&security, &mut serie);
+                (ticker, serie)
+            }));
+        }
+    }
+}
+
+#[test]
+fn sinks() {
+    use std::sync::mpsc;
+
+    let bar = Bar {
+        time: Datetime::from_ymd_hms(2019, 12, 2, 14, 30, 0),
+        open: 1.5,
+        high: 2.,
+        low: 1.,
+        close: 1.25,
+        volume: 100,
+        num_events: 3,
+        value: 150.,
+    };
+    let mut csv = Csv::new(Vec::new());
+    csv.send(bar.clone()).unwrap();
+    assert_eq!(
+        String::from_utf8(csv.into_inner()).unwrap(),
+        "2019-12-02T14:30:00.000,1.5,2,1,1.25,100,3,150\n"
+    );
+
+    let mut field = Vec::new();
+    write_field(&mut field, b"R6").unwrap();
+    write_field(&mut field, b"R6,IS").unwrap();
+    write_field(&mut field, b"\"Q\"").unwrap();
+    assert_eq!(field, &b"R6\"R6,IS\"\"\"\"Q\"\"\""[..]);
+
+    let (mut sender, receiver) = mpsc::sync_channel(1);
+    Sink::send(&mut sender, bar.clone()).unwrap();
+    drop(receiver);
+    assert!(Sink::send(&mut sender, bar).is_err());
+
+    let mut count = 0;
+    let mut closure = |_: Bar| {
+        count += 1;
+        Ok(())
+    };
+    closure.send(Bar::default()).unwrap();
+    assert_eq!(count, 1);
+}
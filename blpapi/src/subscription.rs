@@ -0,0 +1,322 @@
+use crate::{
+    message::Message,
+    name::{self, Name},
+    ref_data::RefData,
+    ring::{Ring, Swap},
+    session::Session,
+    subscription_list::SubscriptionList,
+    Error,
+};
+use std::collections::{HashMap, VecDeque};
+use std::sync::{
+    atomic::{AtomicUsize, Ordering},
+    Arc, Mutex,
+};
+
+/// Subscribed topics, by correlation id, along with their index in their subscription
+pub(crate) type Registry = Arc<Mutex<HashMap<u64, (Arc<dyn Dispatch>, usize)>>>;
+
+/// Options for subscriptions
+#[derive(Debug, Clone, Copy)]
+pub struct SubscriptionOptions {
+    /// Number of consumers, each of them receiving every tick
+    consumers: usize,
+    /// Capacity of each consumer queue
+    capacity: usize,
+    /// Only keep the latest value per topic
+    conflate: bool,
+}
+
+impl Default for SubscriptionOptions {
+    fn default() -> Self {
+        SubscriptionOptions {
+            consumers: 1,
+            capacity: 1024,
+            conflate: false,
+        }
+    }
+}
+
+impl SubscriptionOptions {
+    /// Set number of consumers
+    pub fn with_consumers(mut self, consumers: usize) -> Self {
+        self.consumers = consumers;
+        self
+    }
+
+    /// Set capacity of each consumer queue
+    ///
+    /// Ticks are dropped when a consumer queue is full.
+    /// Ignored when conflating.
+    pub fn with_capacity(mut self, capacity: usize) -> Self {
+        self.capacity = capacity;
+        self
+    }
+
+    /// Conflate ticks: a slow consumer only sees the latest value of each topic
+    pub fn with_conflation(mut self, conflate: bool) -> Self {
+        self.conflate = conflate;
+        self
+    }
+}
+
+/// A tick: the latest known value of a subscribed topic
+#[derive(Debug, Clone)]
+pub struct Tick<R> {
+    /// Index of the topic in the subscription
+    pub topic: usize,
+    pub value: R,
+}
+
+/// A topic which stopped ticking
+#[derive(Debug, Clone)]
+pub struct Failure {
+    /// Index of the topic in the subscription
+    pub topic: usize,
+    /// `SubscriptionFailure` or `SubscriptionTerminated`
+    pub status: Name,
+    pub category: String,
+    pub description: String,
+}
+
+/// A running subscription
+///
+/// Topics are unsubscribed on drop.
+pub struct Subscription<R> {
+    session: Arc<Session>,
+    registry: Registry,
+    list: SubscriptionList,
+    ids: Vec<u64>,
+    topics: Vec<String>,
+    consumers: Vec<Consumer<R>>,
+}
+
+impl<R: RefData + Clone + Send + 'static> Subscription<R> {
+    pub(crate) fn new(
+        session: &Arc<Session>,
+        registry: &Registry,
+        topics: Vec<String>,
+        options: SubscriptionOptions,
+    ) -> Result<Self, Error> {
+        let queues = (0..options.consumers)
+            .map(|_| {
+                let buffer = if options.conflate {
+                    Buffer::Conflated {
+                        topics: Ring::with_capacity(topics.len()),
+                        slots: topics.iter().map(|_| Swap::default()).collect(),
+                    }
+                } else {
+                    Buffer::Ticks(Ring::with_capacity(options.capacity))
+                };
+                Arc::new(Queue {
+                    buffer,
+                    dropped: AtomicUsize::new(0),
+                    failures: Mutex::default(),
+                })
+            })
+            .collect::<Vec<_>>();
+        let consumers = queues
+            .iter()
+            .map(|queue| Consumer {
+                queue: queue.clone(),
+            })
+            .collect();
+        let dispatcher: Arc<dyn Dispatch> = Arc::new(Dispatcher {
+            names: R::FIELDS.iter().map(|f| Name::new(f)).collect(),
+            states: topics.iter().map(|_| Mutex::new(R::default())).collect(),
+            queues,
+        });
+
+        let mut list = SubscriptionList::new();
+        let mut ids = Vec::with_capacity(topics.len());
+        for topic in &topics {
+            let correlation_id = session.new_correlation_id();
+            list.add(topic, &correlation_id, R::FIELDS)?;
+            ids.extend(correlation_id.value_u64());
+        }
+
+        // register before subscribing so no tick can be missed
+        {
+            let mut registry = registry.lock().unwrap();
+            for (i, id) in ids.iter().enumerate() {
+                registry.insert(*id, (dispatcher.clone(), i));
+            }
+        }
+        let subscription = Subscription {
+            session: session.clone(),
+            registry: registry.clone(),
+            list,
+            ids,
+            topics,
+            consumers,
+        };
+        session.subscribe(&subscription.list)?;
+        Ok(subscription)
+    }
+}
+
+impl<R> Subscription<R> {
+    /// Get subscribed topics, a `Tick` topic being an index in this slice
+    pub fn topics(&self) -> &[String] {
+        &self.topics
+    }
+
+    /// Take the consumers, one per consumer thread
+    pub fn take_consumers(&mut self) -> Vec<Consumer<R>> {
+        std::mem::replace(&mut self.consumers, Vec::new())
+    }
+}
+
+impl<R> Drop for Subscription<R> {
+    fn drop(&mut self) {
+        if let Err(e) = self.session.unsubscribe(&self.list) {
+            log::warn!("cannot unsubscribe: {}", e);
+        }
+        let mut registry = self.registry.lock().unwrap();
+        for id in &self.ids {
+            registry.remove(id);
+        }
+    }
+}
+
+/// A consumer of subscription ticks
+pub struct Consumer<R> {
+    queue: Arc<Queue<R>>,
+}
+
+impl<R> Consumer<R> {
+    /// Get next tick, if any
+    pub fn try_recv(&mut self) -> Option<Tick<R>> {
+        match self.queue.buffer {
+            Buffer::Ticks(ref ring) => ring.pop(),
+            Buffer::Conflated {
+                ref topics,
+                ref slots,
+            } => {
+                let topic = topics.pop()?;
+                let value = slots[topic].take()?;
+                Some(Tick { topic, value })
+            }
+        }
+    }
+
+    /// Get next topic failure, if any
+    ///
+    /// A failed or terminated topic doesn't tick anymore.
+    pub fn try_recv_failure(&mut self) -> Option<Failure> {
+        self.queue.failures.lock().unwrap().pop_front()
+    }
+
+    /// Get an iterator over all the ticks currently available
+    pub fn try_iter(&mut self) -> impl Iterator<Item = Tick<R>> + '_ {
+        std::iter::from_fn(move || self.try_recv())
+    }
+
+    /// Number of ticks dropped, or conflated, because this consumer was lagging
+    pub fn dropped(&self) -> usize {
+        self.queue.dropped.load(Ordering::Relaxed)
+    }
+}
+
+struct Queue<R> {
+    buffer: Buffer<R>,
+    dropped: AtomicUsize,
+    /// Failed topics, rare enough to be locked
+    failures: Mutex<VecDeque<Failure>>,
+}
+
+enum Buffer<R> {
+    /// All the ticks, in order
+    Ticks(Ring<Tick<R>>),
+    /// Latest value per topic, along with the topics updated since last read.
+    /// A topic is queued only when its slot goes from empty to full, and the
+    /// consumer empties a slot only after popping its topic, so `topics` holds
+    /// each topic at most once and can never overflow.
+    Conflated {
+        topics: Ring<usize>,
+        slots: Vec<Swap<R>>,
+    },
+}
+
+impl<R: Clone> Queue<R> {
+    fn publish(&self, topic: usize, value: &R) {
+        match self.buffer {
+            Buffer::Ticks(ref ring) => {
+                let tick = Tick {
+                    topic,
+                    value: value.clone(),
+                };
+                if ring.push(tick).is_err() {
+                    self.dropped.fetch_add(1, Ordering::Relaxed);
+                }
+            }
+            Buffer::Conflated {
+                ref topics,
+                ref slots,
+            } => {
+                if slots[topic].put(value.clone()).is_none() {
+                    let _ = topics.push(topic);
+                } else {
+                    self.dropped.fetch_add(1, Ordering::Relaxed);
+                }
+            }
+        }
+    }
+}
+
+/// Receives subscription messages, on the session pump thread
+pub(crate) trait Dispatch: Send + Sync {
+    fn on_message(&self, topic: usize, message: &Message);
+
+    /// A `SubscriptionFailure` or `SubscriptionTerminated` message
+    fn on_failure(&self, topic: usize, message: &Message);
+}
+
+struct Dispatcher<R> {
+    names: Vec<Name>,
+    /// Latest known value per topic, updated by each tick
+    ///
+    /// Ticks are only dispatched on the pump thread, so these locks are never
+    /// contended: they only make the dispatcher `Sync`. Consumers never lock
+    /// them, they read the published copies.
+    states: Vec<Mutex<R>>,
+    queues: Vec<Arc<Queue<R>>>,
+}
+
+impl<R: RefData + Clone + Send> Dispatch for Dispatcher<R> {
+    fn on_message(&self, topic: usize, message: &Message) {
+        let element = message.element();
+        let mut state = self.states[topic].lock().unwrap();
+        let mut updated = false;
+        for name in &self.names {
+            if let Some(value) = element.get_named_element(name) {
+                state.on_named_field(name, &value);
+                updated = true;
+            }
+        }
+        if updated {
+            for queue in &self.queues {
+                queue.publish(topic, &state);
+            }
+        }
+    }
+
+    fn on_failure(&self, topic: usize, message: &Message) {
+        let reason = message.element().get_named_element(&name::REASON);
+        let reason_value = |name: &Name| {
+            reason
+                .as_ref()
+                .and_then(|r| r.named_element_value(name))
+                .unwrap_or_else(String::new)
+        };
+        let failure = Failure {
+            topic,
+            status: message.message_type(),
+            category: reason_value(&name::CATEGORY),
+            description: reason_value(&name::DESCRIPTION),
+        };
+        for queue in &self.queues {
+            queue.failures.lock().unwrap().push_back(failure.clone());
+        }
+    }
+}
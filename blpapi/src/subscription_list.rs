@@ -0,0 +1,60 @@
+use crate::{correlation_id::CorrelationId, Error};
+use blpapi_sys::*;
+use std::ffi::CString;
+use std::os::raw::c_char;
+use std::ptr;
+
+/// A `SubscriptionList`
+pub struct SubscriptionList(pub(crate) *mut blpapi_SubscriptionList_t);
+
+impl SubscriptionList {
+    /// Create a new empty list
+    pub fn new() -> Self {
+        unsafe { SubscriptionList(blpapi_SubscriptionList_create()) }
+    }
+
+    /// Add a new topic with its fields
+    pub fn add(
+        &mut self,
+        topic: &str,
+        correlation_id: &CorrelationId,
+        fields: &[&str],
+    ) -> Result<(), Error> {
+        let topic = CString::new(topic).unwrap();
+        let fields = fields
+            .iter()
+            .map(|f| CString::new(*f).unwrap())
+            .collect::<Vec<_>>();
+        let mut field_ptrs = fields.iter().map(|f| f.as_ptr()).collect::<Vec<_>>();
+        let options: *mut *const c_char = ptr::null_mut();
+        unsafe {
+            let res = blpapi_SubscriptionList_add(
+                self.0,
+                topic.as_ptr(),
+                &correlation_id.0 as *const _,
+                field_ptrs.as_mut_ptr(),
+                options,
+                field_ptrs.len(),
+                0,
+            );
+            Error::check(res)
+        }
+    }
+
+    /// Number of topics
+    pub fn len(&self) -> usize {
+        unsafe { blpapi_SubscriptionList_size(self.0) as usize }
+    }
+}
+
+impl Default for SubscriptionList {
+    fn default() -> Self {
+        SubscriptionList::new()
+    }
+}
+
+impl Drop for SubscriptionList {
+    fn drop(&mut self) {
+        unsafe { blpapi_SubscriptionList_destroy(self.0) }
+    }
+}
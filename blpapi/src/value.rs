@@ -0,0 +1,380 @@
+//! Owned element values
+//!
+//! A `Value` is a copy of a scalar (or array of scalars) element value which
+//! outlives its message, e.g. to be cached. It can be converted back into the
+//! `RefData` field types with `FromValue`.
+
+use crate::{
+    datetime::{Datetime, HighPrecisionDatetime},
+    element::{DataType, Element},
+    name::Name,
+};
+use std::cell::RefCell;
+use std::collections::HashSet;
+use std::hash::Hash;
+
+/// An owned element value
+#[derive(Debug, Clone)]
+pub enum Value {
+    /// No value
+    Null,
+    Bool(bool),
+    Int(i64),
+    Float(f64),
+    String(String),
+    Datetime(Datetime),
+    List(Vec<Value>),
+}
+
+impl Value {
+    /// Copy the value of an element
+    ///
+    /// Returns `None` for sequence and choice elements (e.g. bulk fields)
+    pub fn from_element(element: &Element) -> Option<Value> {
+        match element.datatype() {
+            DataType::Sequence | DataType::Choice => None,
+            _ if element.is_array() => (0..element.num_values())
+                .map(|i| Value::from_element_at(element, i))
+                .collect::<Option<_>>()
+                .map(Value::List),
+            _ if element.is_null() || element.num_values() == 0 => Some(Value::Null),
+            _ => Value::from_element_at(element, 0),
+        }
+    }
+
+    fn from_element_at(element: &Element, index: usize) -> Option<Value> {
+        let value = match element.datatype() {
+            DataType::Sequence | DataType::Choice => return None,
+            DataType::Bool => element.get_at(index).map(Value::Bool),
+            DataType::Char | DataType::Byte | DataType::Int32 | DataType::Int64 => {
+                element.get_at(index).map(Value::Int)
+            }
+            DataType::Float32 | DataType::Float64 | DataType::Decimal => {
+                element.get_at(index).map(Value::Float)
+            }
+            DataType::Date | DataType::Time | DataType::Datetime => {
+                element.get_at(index).map(Value::Datetime)
+            }
+            _ => element.get_at(index).map(Value::String),
+        };
+        Some(value.unwrap_or(Value::Null))
+    }
+
+    /// Is null
+    pub fn is_null(&self) -> bool {
+        match self {
+            Value::Null => true,
+            _ => false,
+        }
+    }
+}
+
+/// A trait to convert a `Value` into a `RefData` field
+pub trait FromValue: Sized {
+    /// Convert value, if possible
+    fn from_value(value: &Value) -> Option<Self>;
+}
+
+impl FromValue for bool {
+    fn from_value(value: &Value) -> Option<Self> {
+        match value {
+            Value::Bool(b) => Some(*b),
+            Value::Int(i) => Some(*i != 0),
+            _ => None,
+        }
+    }
+}
+
+macro_rules! impl_from_value_number {
+    ($($ty:ty),*) => {
+        $(
+            impl FromValue for $ty {
+                fn from_value(value: &Value) -> Option<Self> {
+                    match value {
+                        Value::Int(i) => Some(*i as $ty),
+                        Value::Float(f) => Some(*f as $ty),
+                        Value::Bool(b) => Some(*b as u8 as $ty),
+                        Value::String(s) => s.parse().ok(),
+                        _ => None,
+                    }
+                }
+            }
+        )*
+    };
+}
+
+impl_from_value_number!(i8, i32, i64, f32, f64);
+
+impl FromValue for String {
+    fn from_value(value: &Value) -> Option<Self> {
+        match value {
+            Value::String(s) => Some(s.clone()),
+            Value::Int(i) => Some(i.to_string()),
+            Value::Float(f) => Some(f.to_string()),
+            Value::Bool(b) => Some(b.to_string()),
+            Value::Datetime(d) => Some(format!("{:?}", d)),
+            Value::Null | Value::List(_) => None,
+        }
+    }
+}
+
+impl FromValue for Datetime {
+    fn from_value(value: &Value) -> Option<Self> {
+        match value {
+            Value::Datetime(d) => Some(*d),
+            _ => None,
+        }
+    }
+}
+
+impl FromValue for Name {
+    fn from_value(value: &Value) -> Option<Self> {
+        match value {
+            Value::String(s) => Some(Name::new(s)),
+            _ => None,
+        }
+    }
+}
+
+impl<T: FromValue> FromValue for Option<T> {
+    fn from_value(value: &Value) -> Option<Self> {
+        T::from_value(value).map(Some)
+    }
+}
+
+impl<T: FromValue> FromValue for Vec<T> {
+    fn from_value(value: &Value) -> Option<Self> {
+        match value {
+            Value::List(values) => Some(values.iter().filter_map(T::from_value).collect()),
+            Value::Null => None,
+            value => Some(T::from_value(value).into_iter().collect()),
+        }
+    }
+}
+
+impl<T: FromValue + Hash + Eq> FromValue for HashSet<T> {
+    fn from_value(value: &Value) -> Option<Self> {
+        Vec::<T>::from_value(value).map(|v| v.into_iter().collect())
+    }
+}
+
+#[cfg(feature = "dates")]
+impl FromValue for chrono::NaiveDate {
+    fn from_value(value: &Value) -> Option<Self> {
+        Datetime::from_value(value).and_then(|d| {
+            chrono::NaiveDate::from_ymd_opt(d.0.year as i32, d.0.month as u32, d.0.day as u32)
+        })
+    }
+}
+
+impl FromValue for HighPrecisionDatetime {
+    fn from_value(value: &Value) -> Option<Self> {
+        Datetime::from_value(value).map(HighPrecisionDatetime::from)
+    }
+}
+
+#[cfg(feature = "dates")]
+impl FromValue for chrono::NaiveDateTime {
+    fn from_value(value: &Value) -> Option<Self> {
+        HighPrecisionDatetime::from_value(value).and_then(|d| d.to_naive_datetime())
+    }
+}
+
+#[cfg(feature = "dates")]
+impl FromValue for chrono::DateTime<chrono::Utc> {
+    fn from_value(value: &Value) -> Option<Self> {
+        HighPrecisionDatetime::from_value(value).and_then(|d| d.to_utc())
+    }
+}
+
+/// Encode a length prefixed string
+pub(crate) fn encode_str(buf: &mut Vec<u8>, s: &str) {
+    buf.extend_from_slice(&(s.len() as u32).to_le_bytes());
+    buf.extend_from_slice(s.as_bytes());
+}
+
+/// Encode a value, decoded back by `Reader::value`
+pub(crate) fn encode_value(buf: &mut Vec<u8>, value: &Value) {
+    match value {
+        Value::Null => buf.push(0),
+        Value::Bool(b) => buf.extend_from_slice(&[1, *b as u8]),
+        Value::Int(i) => {
+            buf.push(2);
+            buf.extend_from_slice(&i.to_le_bytes());
+        }
+        Value::Float(f) => {
+            buf.push(3);
+            buf.extend_from_slice(&f.to_bits().to_le_bytes());
+        }
+        Value::String(s) => {
+            buf.push(4);
+            encode_str(buf, s);
+        }
+        Value::Datetime(d) => {
+            let d = d.0;
+            buf.extend_from_slice(&[5, d.parts, d.hours, d.minutes, d.seconds]);
+            buf.extend_from_slice(&d.milliSeconds.to_le_bytes());
+            buf.extend_from_slice(&[d.month, d.day]);
+            buf.extend_from_slice(&d.year.to_le_bytes());
+            buf.extend_from_slice(&d.offset.to_le_bytes());
+        }
+        Value::List(values) => {
+            buf.push(6);
+            buf.extend_from_slice(&(values.len() as u32).to_le_bytes());
+            for value in values {
+                encode_value(buf, value);
+            }
+        }
+    }
+}
+
+/// A cursor over encoded records
+pub(crate) struct Reader<'a> {
+    bytes: &'a [u8],
+    /// Position of the next byte to read
+    pub(crate) pos: usize,
+}
+
+impl<'a> Reader<'a> {
+    pub(crate) fn new(bytes: &'a [u8]) -> Self {
+        Reader { bytes, pos: 0 }
+    }
+
+    pub(crate) fn take(&mut self, len: usize) -> Option<&'a [u8]> {
+        let bytes = self.bytes.get(self.pos..self.pos.checked_add(len)?)?;
+        self.pos += len;
+        Some(bytes)
+    }
+
+    pub(crate) fn u8(&mut self) -> Option<u8> {
+        self.take(1).map(|b| b[0])
+    }
+
+    pub(crate) fn u16(&mut self) -> Option<u16> {
+        let mut b = [0; 2];
+        b.copy_from_slice(self.take(2)?);
+        Some(u16::from_le_bytes(b))
+    }
+
+    pub(crate) fn u32(&mut self) -> Option<u32> {
+        let mut b = [0; 4];
+        b.copy_from_slice(self.take(4)?);
+        Some(u32::from_le_bytes(b))
+    }
+
+    pub(crate) fn u64(&mut self) -> Option<u64> {
+        let mut b = [0; 8];
+        b.copy_from_slice(self.take(8)?);
+        Some(u64::from_le_bytes(b))
+    }
+
+    pub(crate) fn i32(&mut self) -> Option<i32> {
+        self.u32().map(|v| v as i32)
+    }
+
+    pub(crate) fn string(&mut self) -> Option<String> {
+        let len = self.u32()? as usize;
+        String::from_utf8(self.take(len)?.to_vec()).ok()
+    }
+
+    pub(crate) fn value(&mut self) -> Option<Value> {
+        let value = match self.u8()? {
+            0 => Value::Null,
+            1 => Value::Bool(self.u8()? != 0),
+            2 => Value::Int(self.u64()? as i64),
+            3 => Value::Float(f64::from_bits(self.u64()?)),
+            4 => Value::String(self.string()?),
+            5 => {
+                let mut d = Datetime::default();
+                d.0.parts = self.u8()?;
+                d.0.hours = self.u8()?;
+                d.0.minutes = self.u8()?;
+                d.0.seconds = self.u8()?;
+                d.0.milliSeconds = self.u16()?;
+                d.0.month = self.u8()?;
+                d.0.day = self.u8()?;
+                d.0.year = self.u16()?;
+                d.0.offset = self.u16()? as i16;
+                Value::Datetime(d)
+            }
+            6 => {
+                let len = self.u32()?;
+                let values = (0..len).map(|_| self.value()).collect::<Option<_>>()?;
+                Value::List(values)
+            }
+            _ => return None,
+        };
+        Some(value)
+    }
+}
+
+/// A struct field, set from a `Value` by the `RefData` derive
+///
+/// Fields implementing `FromValue` are set with `SetFromValue`, any other
+/// field (e.g. the rows of a bulk field) falls back to `SetNoValue`, which leaves it
+/// untouched. Call it as `(&&Slot::new(&mut field)).set_value(value)`.
+#[doc(hidden)]
+pub struct Slot<'a, T>(RefCell<&'a mut T>);
+
+impl<'a, T> Slot<'a, T> {
+    pub fn new(field: &'a mut T) -> Self {
+        Slot(RefCell::new(field))
+    }
+}
+
+#[doc(hidden)]
+pub trait SetFromValue {
+    fn set_value(&self, value: &Value) -> bool;
+}
+
+/// Returns `false` if a non null value cannot be converted, e.g. a cached value
+/// of another type: the field is left untouched and must be fetched again
+impl<'a, T: FromValue> SetFromValue for &Slot<'a, T> {
+    fn set_value(&self, value: &Value) -> bool {
+        match T::from_value(value) {
+            Some(v) => {
+                **self.0.borrow_mut() = v;
+                true
+            }
+            None => value.is_null(),
+        }
+    }
+}
+
+#[doc(hidden)]
+pub trait SetNoValue {
+    fn set_value(&self, value: &Value) -> bool;
+}
+
+impl<'a, T> SetNoValue for Slot<'a, T> {
+    fn set_value(&self, _value: &Value) -> bool {
+        false
+    }
+}
+
+#[test]
+fn from_value() {
+    assert_eq!(f64::from_value(&Value::Int(3)), Some(3.));
+    assert_eq!(i64::from_value(&Value::String("42".into())), Some(42));
+    assert_eq!(String::from_value(&Value::Null), None);
+    assert_eq!(
+        Option::<String>::from_value(&Value::String("USD".into())),
+        Some(Some("USD".into()))
+    );
+    let list = Value::List(vec![Value::Int(1), Value::Int(2)]);
+    assert_eq!(Vec::<i32>::from_value(&list), Some(vec![1, 2]));
+    assert_eq!(Vec::<i32>::from_value(&Value::Int(1)), Some(vec![1]));
+}
+
+#[test]
+fn slot() {
+    let mut price = 0.;
+    assert!((&&Slot::new(&mut price)).set_value(&Value::Float(1.5)));
+    assert!((&&Slot::new(&mut price)).set_value(&Value::Null));
+    assert!(!(&&Slot::new(&mut price)).set_value(&Value::String("n/a".into())));
+    assert_eq!(price, 1.5);
+
+    struct Row;
+    let mut rows = vec![Row];
+    assert!(!(&&Slot::new(&mut rows)).set_value(&Value::Null));
+}
@@ -0,0 +1,254 @@
+//! Decoding an event, through `Event::messages()` and `on_named_field`, must
+//! not allocate: blpapi functions are mocked with static data (defined here,
+//! they take precedence over the library ones)
+#![cfg(target_os = "linux")]
+
+use blpapi::{
+    element::Element, lazy_static::lazy_static, name::Name, ref_data::FieldIndex,
+    replay::EventSource, session_options::SessionOptions, RefData,
+};
+use blpapi_sys::*;
+use std::alloc::{GlobalAlloc, Layout, System};
+use std::ffi::CStr;
+use std::os::raw::{c_char, c_int, c_uint, c_void};
+use std::ptr::NonNull;
+use std::sync::atomic::{AtomicBool, AtomicUsize, Ordering};
+
+/// An allocator counting allocations
+struct Counting;
+
+static ALLOCATIONS: AtomicUsize = AtomicUsize::new(0);
+
+unsafe impl GlobalAlloc for Counting {
+    unsafe fn alloc(&self, layout: Layout) -> *mut u8 {
+        ALLOCATIONS.fetch_add(1, Ordering::SeqCst);
+        System.alloc(layout)
+    }
+    unsafe fn dealloc(&self, ptr: *mut u8, layout: Layout) {
+        System.dealloc(ptr, layout)
+    }
+}
+
+#[global_allocator]
+static GLOBAL: Counting = Counting;
+
+fn allocations<F: FnOnce()>(f: F) -> usize {
+    let start = ALLOCATIONS.load(Ordering::SeqCst);
+    f();
+    ALLOCATIONS.load(Ordering::SeqCst) - start
+}
+
+/// Interned names, `blpapi_Name_t` pointers are their addresses
+static NAMES: [&[u8]; 3] = [b"PX_LAST\0", b"PX_OPEN\0", b"VOLUME\0"];
+
+/// A mock field element: a name and a single value
+struct MockField {
+    name: usize,
+    value: f64,
+}
+
+/// The single message of every event, with its fields
+static FIELDS: [MockField; 3] = [
+    MockField {
+        name: 0,
+        value: 101.5,
+    },
+    MockField {
+        name: 2,
+        value: 2e6,
+    },
+    MockField {
+        name: 1,
+        value: 99.25,
+    },
+];
+static MESSAGE: u8 = 0;
+static EVENT: u8 = 0;
+
+/// The message iterator state, kept static not to allocate
+static ITERATED: AtomicBool = AtomicBool::new(false);
+
+fn name_ptr(i: usize) -> *mut blpapi_Name_t {
+    NAMES[i] as *const [u8] as *const u8 as *mut blpapi_Name_t
+}
+
+#[no_mangle]
+pub extern "C" fn blpapi_SessionOptions_create() -> *mut blpapi_SessionOptions_t {
+    NonNull::dangling().as_ptr()
+}
+
+#[no_mangle]
+pub extern "C" fn blpapi_SessionOptions_destroy(_parameters: *mut blpapi_SessionOptions_t) {}
+
+#[no_mangle]
+pub extern "C" fn blpapi_Session_create(
+    _parameters: *mut blpapi_SessionOptions_t,
+    _handler: blpapi_EventHandler_t,
+    _dispatcher: *mut blpapi_EventDispatcher_t,
+    _user_data: *mut c_void,
+) -> *mut blpapi_Session_t {
+    NonNull::dangling().as_ptr()
+}
+
+#[no_mangle]
+pub extern "C" fn blpapi_Session_destroy(_session: *mut blpapi_Session_t) {}
+
+#[no_mangle]
+pub unsafe extern "C" fn blpapi_Session_nextEvent(
+    _session: *mut blpapi_Session_t,
+    event: *mut *mut blpapi_Event_t,
+    _timeout: c_uint,
+) -> c_int {
+    *event = &EVENT as *const u8 as *mut blpapi_Event_t;
+    0
+}
+
+#[no_mangle]
+pub extern "C" fn blpapi_Event_release(_event: *const blpapi_Event_t) -> c_int {
+    0
+}
+
+#[no_mangle]
+pub extern "C" fn blpapi_MessageIterator_create(
+    _event: *const blpapi_Event_t,
+) -> *mut blpapi_MessageIterator_t {
+    ITERATED.store(false, Ordering::SeqCst);
+    NonNull::dangling().as_ptr()
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn blpapi_MessageIterator_next(
+    _iterator: *mut blpapi_MessageIterator_t,
+    message: *mut *mut blpapi_Message_t,
+) -> c_int {
+    if ITERATED.swap(true, Ordering::SeqCst) {
+        return 1;
+    }
+    *message = &MESSAGE as *const u8 as *mut blpapi_Message_t;
+    0
+}
+
+#[no_mangle]
+pub extern "C" fn blpapi_MessageIterator_destroy(_iterator: *mut blpapi_MessageIterator_t) {}
+
+/// The message root element is the message itself
+#[no_mangle]
+pub extern "C" fn blpapi_Message_elements(
+    message: *const blpapi_Message_t,
+) -> *mut blpapi_Element_t {
+    message as *mut blpapi_Element_t
+}
+
+#[no_mangle]
+pub extern "C" fn blpapi_Element_numElements(element: *const blpapi_Element_t) -> usize {
+    if element as *const u8 == &MESSAGE {
+        FIELDS.len()
+    } else {
+        0
+    }
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn blpapi_Element_getElementAt(
+    _element: *const blpapi_Element_t,
+    result: *mut *mut blpapi_Element_t,
+    position: usize,
+) -> c_int {
+    *result = &FIELDS[position] as *const MockField as *mut blpapi_Element_t;
+    0
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn blpapi_Element_name(
+    element: *const blpapi_Element_t,
+) -> *mut blpapi_Name_t {
+    name_ptr((*(element as *const MockField)).name)
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn blpapi_Element_getValueAsFloat64(
+    element: *const blpapi_Element_t,
+    buffer: *mut blpapi_Float64_t,
+    _index: usize,
+) -> c_int {
+    *buffer = (*(element as *const MockField)).value;
+    0
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn blpapi_Name_create(name: *const c_char) -> *mut blpapi_Name_t {
+    let name = CStr::from_ptr(name).to_bytes_with_nul();
+    match NAMES.iter().position(|n| *n == name) {
+        Some(i) => name_ptr(i),
+        None => std::ptr::null_mut(),
+    }
+}
+
+#[no_mangle]
+pub extern "C" fn blpapi_Name_destroy(_name: *mut blpapi_Name_t) {}
+
+#[no_mangle]
+pub extern "C" fn blpapi_Name_duplicate(src: *const blpapi_Name_t) -> *mut blpapi_Name_t {
+    src as *mut blpapi_Name_t
+}
+
+#[no_mangle]
+pub extern "C" fn blpapi_Name_string(name: *const blpapi_Name_t) -> *const c_char {
+    name as *const c_char
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn blpapi_Name_length(name: *const blpapi_Name_t) -> usize {
+    CStr::from_ptr(name as *const c_char).to_bytes().len()
+}
+
+#[derive(Default, Debug)]
+struct Price {
+    px_last: f64,
+    px_open: f64,
+}
+
+lazy_static! {
+    static ref INDEX: FieldIndex = FieldIndex::new(Price::FIELDS);
+}
+
+impl RefData for Price {
+    const FIELDS: &'static [&'static str] = &["PX_LAST", "PX_OPEN"];
+    fn on_field(&mut self, field: &str, element: &Element) {
+        self.on_named_field(&Name::new(field), element)
+    }
+    fn on_named_field(&mut self, field: &Name, element: &Element) {
+        match INDEX.get(field) {
+            Some(0) => self.px_last = element.get_at(0).unwrap_or_default(),
+            Some(1) => self.px_open = element.get_at(0).unwrap_or_default(),
+            _ => (),
+        }
+    }
+}
+
+#[test]
+fn decode_event_does_not_allocate() {
+    let mut session = SessionOptions::default().sync();
+    let mut decode = |price: &mut Price| {
+        let event = session.next_event(None).unwrap();
+        for message in event.messages() {
+            for field in message.element().elements() {
+                price.on_named_field(&field.name(), &field);
+            }
+        }
+    };
+
+    // warm up the lazy statics
+    let mut price = Price::default();
+    decode(&mut price);
+
+    let count = allocations(|| {
+        for _ in 0..1000 {
+            price = Price::default();
+            decode(&mut price);
+        }
+    });
+    assert_eq!(count, 0);
+    assert_eq!(price.px_last, 101.5);
+    assert_eq!(price.px_open, 99.25);
+}
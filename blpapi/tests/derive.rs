@@ -1,13 +1,111 @@
 #![cfg(feature = "derive")]
 
-use blpapi::RefData;
+use blpapi::{
+    element::{Element, GetValue},
+    value::Value,
+    RefData,
+};
 
 #[derive(Default, RefData)]
 pub struct Equity {
     pub crncy: String,
 }
 
+fn double(element: &Element) -> Option<f64> {
+    element.get_at(0).map(|v: f64| v * 2.)
+}
+
+#[derive(Default, RefData)]
+pub struct Renamed {
+    #[blp(field = "PX_LAST")]
+    pub last: f64,
+    #[blp(field = "PX_BID", decode = "double")]
+    pub bid: f64,
+    pub crncy: Option<String>,
+}
+
+/// A row of a bulk field, decoded from its sequence element
+#[derive(Default, Debug)]
+pub struct Weight {
+    pub member: String,
+    pub weight: f64,
+}
+
+impl<'a> GetValue<'a> for Weight {
+    fn get_at(element: &Element<'a>, index: usize) -> Option<Self> {
+        let row: Element = element.get_at(index)?;
+        Some(Weight {
+            member: row.element_value("Member Ticker and Exchange Code")?,
+            weight: row.element_value("Percentage Weight")?,
+        })
+    }
+}
+
+#[derive(Default, RefData)]
+pub struct Bulk {
+    pub crncy: String,
+    pub indx_mweight: Vec<Weight>,
+    pub indx_mweight_hist: Option<Vec<Weight>>,
+}
+
+#[cfg(feature = "dates")]
+#[derive(Default, RefData)]
+pub struct Dates {
+    pub last_update_dt: Option<chrono::NaiveDate>,
+    pub last_update: Option<chrono::NaiveDateTime>,
+    pub last_trade: Option<chrono::DateTime<chrono::Utc>>,
+    pub time: Option<blpapi::datetime::HighPrecisionDatetime>,
+}
+
 #[test]
 fn derive_equity() {
     assert_eq!(Equity::FIELDS, &["CRNCY"]);
 }
+
+#[test]
+fn derive_renamed() {
+    assert_eq!(Renamed::FIELDS, &["PX_LAST", "PX_BID", "CRNCY"]);
+}
+
+#[test]
+fn derive_on_value() {
+    let mut renamed = Renamed::default();
+    assert!(renamed.on_value("PX_LAST", &Value::Float(1.5)));
+    assert!(!renamed.on_value("PX_BID", &Value::Float(1.5)));
+    assert!(renamed.on_value("CRNCY", &Value::String("USD".into())));
+    assert!(!renamed.on_value("PX_ASK", &Value::Float(1.5)));
+    assert_eq!(renamed.last, 1.5);
+    assert_eq!(renamed.crncy.as_ref().map(|s| &**s), Some("USD"));
+}
+
+#[test]
+fn derive_on_value_bulk() {
+    let mut bulk = Bulk::default();
+    assert!(bulk.on_value("CRNCY", &Value::String("USD".into())));
+    assert!(!bulk.on_value("INDX_MWEIGHT", &Value::Null));
+    assert!(!bulk.on_value("INDX_MWEIGHT_HIST", &Value::Null));
+    assert_eq!(bulk.crncy, "USD");
+}
+
+#[cfg(feature = "dates")]
+#[test]
+fn derive_on_value_dates() {
+    use blpapi::datetime::Datetime;
+
+    let mut dates = Dates::default();
+    let value = Value::Datetime(Datetime::from_ymd_hms(2019, 12, 2, 14, 30, 0));
+    for field in Dates::FIELDS {
+        assert!(dates.on_value(field, &value));
+    }
+    assert_eq!(
+        dates.last_update_dt,
+        Some(chrono::NaiveDate::from_ymd_opt(2019, 12, 2).unwrap())
+    );
+    let time = dates.last_update.unwrap();
+    assert_eq!(time.to_string(), "2019-12-02 14:30:00");
+    assert_eq!(dates.last_trade.unwrap().naive_utc(), time);
+    assert_eq!(
+        dates.time.and_then(|t| t.epoch_nanos()),
+        Some(time.and_utc().timestamp_nanos_opt().unwrap())
+    );
+}
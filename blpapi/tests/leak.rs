@@ -0,0 +1,72 @@
+use blpapi::RefData;
+use std::alloc::{GlobalAlloc, Layout, System};
+use std::sync::atomic::{AtomicUsize, Ordering};
+
+/// An allocator counting live bytes
+struct Counting;
+
+static ALLOCATED: AtomicUsize = AtomicUsize::new(0);
+
+unsafe impl GlobalAlloc for Counting {
+    unsafe fn alloc(&self, layout: Layout) -> *mut u8 {
+        ALLOCATED.fetch_add(layout.size(), Ordering::SeqCst);
+        System.alloc(layout)
+    }
+    unsafe fn dealloc(&self, ptr: *mut u8, layout: Layout) {
+        ALLOCATED.fetch_sub(layout.size(), Ordering::SeqCst);
+        System.dealloc(ptr, layout)
+    }
+}
+
+#[global_allocator]
+static GLOBAL: Counting = Counting;
+
+#[derive(Default, Debug)]
+struct Data {
+    crncy: String,
+}
+
+impl RefData for Data {
+    const FIELDS: &'static [&'static str] = &["CRNCY"];
+    fn on_field(&mut self, field: &str, element: &blpapi::element::Element) {
+        if field == "CRNCY" {
+            self.crncy = element.get_at(0).unwrap_or_default();
+        }
+    }
+}
+
+/// Resident memory, in pages
+#[cfg(target_os = "linux")]
+fn resident_pages() -> usize {
+    std::fs::read_to_string("/proc/self/statm")
+        .ok()
+        .and_then(|s| s.split_whitespace().nth(1)?.parse().ok())
+        .unwrap_or(0)
+}
+
+/// Long running sessions should not grow: every event must be released
+///
+/// Requires a running terminal
+#[cfg(target_os = "linux")]
+#[test]
+#[ignore]
+fn ref_data_does_not_leak() -> Result<(), blpapi::Error> {
+    let mut session = blpapi::SessionSync::new()?;
+    let securities = &["IBM US Equity", "MSFT US Equity"];
+
+    // warm up (services, interned names, lazy statics)
+    for _ in 0..100 {
+        session.ref_data::<_, Data>(securities)?;
+    }
+
+    let allocated = ALLOCATED.load(Ordering::SeqCst);
+    let pages = resident_pages();
+    for _ in 0..1000 {
+        session.ref_data::<_, Data>(securities)?;
+    }
+    let allocated = ALLOCATED.load(Ordering::SeqCst).saturating_sub(allocated);
+    let pages = resident_pages().saturating_sub(pages);
+    assert!(allocated < 1024, "rust heap grew by {} bytes", allocated);
+    assert!(pages < 1024, "resident memory grew by {} pages", pages);
+    Ok(())
+}
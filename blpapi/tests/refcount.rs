@@ -0,0 +1,183 @@
+//! Reference counting of events and messages, against a counted mock of the
+//! blpapi functions involved (defined here, they take precedence over the
+//! library ones)
+#![cfg(target_os = "linux")]
+
+use blpapi::{replay::EventSource, session_options::SessionOptions};
+use blpapi_sys::*;
+use std::os::raw::{c_int, c_uint, c_void};
+use std::ptr::NonNull;
+use std::sync::atomic::{AtomicIsize, AtomicUsize, Ordering};
+
+/// A mock event, holding a single message
+struct MockEvent {
+    refs: AtomicIsize,
+    message_refs: AtomicIsize,
+}
+
+const NEW_EVENT: MockEvent = MockEvent {
+    refs: AtomicIsize::new(0),
+    message_refs: AtomicIsize::new(0),
+};
+
+static EVENTS: [MockEvent; 3] = [NEW_EVENT; 3];
+static NEXT_EVENT: AtomicUsize = AtomicUsize::new(0);
+
+fn event_refs() -> Vec<isize> {
+    EVENTS
+        .iter()
+        .map(|e| e.refs.load(Ordering::SeqCst))
+        .collect()
+}
+
+fn message_refs() -> Vec<isize> {
+    EVENTS
+        .iter()
+        .map(|e| e.message_refs.load(Ordering::SeqCst))
+        .collect()
+}
+
+struct MockIterator {
+    event: *const MockEvent,
+    done: bool,
+}
+
+#[no_mangle]
+pub extern "C" fn blpapi_SessionOptions_create() -> *mut blpapi_SessionOptions_t {
+    NonNull::dangling().as_ptr()
+}
+
+#[no_mangle]
+pub extern "C" fn blpapi_SessionOptions_destroy(_parameters: *mut blpapi_SessionOptions_t) {}
+
+#[no_mangle]
+pub extern "C" fn blpapi_Session_create(
+    _parameters: *mut blpapi_SessionOptions_t,
+    _handler: blpapi_EventHandler_t,
+    _dispatcher: *mut blpapi_EventDispatcher_t,
+    _user_data: *mut c_void,
+) -> *mut blpapi_Session_t {
+    NonNull::dangling().as_ptr()
+}
+
+#[no_mangle]
+pub extern "C" fn blpapi_Session_destroy(_session: *mut blpapi_Session_t) {}
+
+/// Deliver each mock event once, with a single reference
+#[no_mangle]
+pub unsafe extern "C" fn blpapi_Session_nextEvent(
+    _session: *mut blpapi_Session_t,
+    event: *mut *mut blpapi_Event_t,
+    _timeout: c_uint,
+) -> c_int {
+    match EVENTS.get(NEXT_EVENT.fetch_add(1, Ordering::SeqCst)) {
+        Some(mock) => {
+            mock.refs.store(1, Ordering::SeqCst);
+            *event = mock as *const MockEvent as *mut blpapi_Event_t;
+            0
+        }
+        None => -1,
+    }
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn blpapi_Event_addRef(event: *const blpapi_Event_t) -> c_int {
+    (*(event as *const MockEvent))
+        .refs
+        .fetch_add(1, Ordering::SeqCst);
+    0
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn blpapi_Event_release(event: *const blpapi_Event_t) -> c_int {
+    (*(event as *const MockEvent))
+        .refs
+        .fetch_sub(1, Ordering::SeqCst);
+    0
+}
+
+#[no_mangle]
+pub extern "C" fn blpapi_MessageIterator_create(
+    event: *const blpapi_Event_t,
+) -> *mut blpapi_MessageIterator_t {
+    let iterator = MockIterator {
+        event: event as *const MockEvent,
+        done: false,
+    };
+    Box::into_raw(Box::new(iterator)) as *mut blpapi_MessageIterator_t
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn blpapi_MessageIterator_next(
+    iterator: *mut blpapi_MessageIterator_t,
+    message: *mut *mut blpapi_Message_t,
+) -> c_int {
+    let iterator = &mut *(iterator as *mut MockIterator);
+    if iterator.done {
+        return 1;
+    }
+    iterator.done = true;
+    *message = &(*iterator.event).message_refs as *const AtomicIsize as *mut blpapi_Message_t;
+    0
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn blpapi_MessageIterator_destroy(iterator: *mut blpapi_MessageIterator_t) {
+    drop(Box::from_raw(iterator as *mut MockIterator));
+}
+
+#[no_mangle]
+pub extern "C" fn blpapi_Message_elements(
+    _message: *const blpapi_Message_t,
+) -> *mut blpapi_Element_t {
+    std::ptr::null_mut()
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn blpapi_Message_addRef(message: *const blpapi_Message_t) -> c_int {
+    (*(message as *const AtomicIsize)).fetch_add(1, Ordering::SeqCst);
+    0
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn blpapi_Message_release(message: *const blpapi_Message_t) -> c_int {
+    (*(message as *const AtomicIsize)).fetch_sub(1, Ordering::SeqCst);
+    0
+}
+
+#[test]
+fn refcount_balanced() {
+    let mut session = SessionOptions::default().sync();
+    session.start_recording();
+    let mut messages = Vec::new();
+    for _ in 0..EVENTS.len() {
+        let event = session.next_event(None).unwrap();
+        let clone = event.clone();
+        drop(event);
+        messages.extend(clone.messages().map(|m| m.to_owned()));
+    }
+    assert!(session.next_event(None).is_err());
+
+    // only the recording is left
+    let mut replay = session.stop_recording();
+    drop(session);
+    assert_eq!(event_refs(), vec![1, 1, 1]);
+
+    // replaying clones each event, once per replay
+    let copy = replay.clone();
+    assert_eq!(event_refs(), vec![2, 2, 2]);
+    let replayed = std::iter::from_fn(|| replay.next_event(None).ok()).collect::<Vec<_>>();
+    assert_eq!(event_refs(), vec![3, 3, 3]);
+    drop(replayed);
+    drop(replay);
+    drop(copy);
+    assert_eq!(event_refs(), vec![0, 0, 0]);
+
+    // owned messages outlive their event
+    assert_eq!(message_refs(), vec![1, 1, 1]);
+    let clone = messages[0].clone();
+    assert_eq!(message_refs(), vec![2, 1, 1]);
+    drop(clone);
+    drop(messages);
+    assert_eq!(message_refs(), vec![0, 0, 0]);
+}
@@ -0,0 +1,148 @@
+//! Offline decoding of recordings, against an interning mock of the blpapi
+//! `Name` functions (defined here, they take precedence over the library
+//! ones)
+#![cfg(target_os = "linux")]
+
+use blpapi::{
+    datetime::Datetime,
+    element::Element,
+    replay::{Node, Recording},
+    value::Value,
+    Error, RefData,
+};
+use blpapi_sys::*;
+use std::collections::HashMap;
+use std::ffi::{CStr, CString};
+use std::os::raw::c_char;
+use std::sync::Mutex;
+
+lazy_static::lazy_static! {
+    static ref NAMES: Mutex<HashMap<CString, usize>> = Mutex::new(HashMap::new());
+}
+
+/// Intern `name`, names are never freed
+#[no_mangle]
+pub unsafe extern "C" fn blpapi_Name_create(name: *const c_char) -> *mut blpapi_Name_t {
+    let name = CStr::from_ptr(name).to_owned();
+    let mut names = NAMES.lock().unwrap();
+    let ptr = names
+        .entry(name)
+        .or_insert_with_key(|name| name.clone().into_raw() as usize);
+    *ptr as *mut blpapi_Name_t
+}
+
+#[no_mangle]
+pub extern "C" fn blpapi_Name_destroy(_name: *mut blpapi_Name_t) {}
+
+#[no_mangle]
+pub extern "C" fn blpapi_Name_duplicate(src: *const blpapi_Name_t) -> *mut blpapi_Name_t {
+    src as *mut blpapi_Name_t
+}
+
+#[no_mangle]
+pub extern "C" fn blpapi_Name_string(name: *const blpapi_Name_t) -> *const c_char {
+    name as *const c_char
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn blpapi_Name_length(name: *const blpapi_Name_t) -> usize {
+    CStr::from_ptr(name as *const c_char).to_bytes().len()
+}
+
+#[derive(Default)]
+struct Price {
+    px_last: Option<f64>,
+    crncy: Option<String>,
+}
+
+impl RefData for Price {
+    const FIELDS: &'static [&'static str] = &["PX_LAST", "CRNCY"];
+    fn on_field(&mut self, _field: &str, _element: &Element) {}
+    fn on_value(&mut self, field: &str, value: &Value) -> bool {
+        match (field, value) {
+            ("PX_LAST", Value::Float(v)) => self.px_last = Some(*v),
+            ("CRNCY", Value::String(v)) => self.crncy = Some(v.clone()),
+            _ => return false,
+        }
+        true
+    }
+}
+
+fn float(value: f64) -> Node {
+    Node::Value(Value::Float(value))
+}
+
+fn string(value: &str) -> Node {
+    Node::Value(Value::String(value.into()))
+}
+
+fn point(day: i32, px: f64) -> Node {
+    let date = Node::Value(Value::Datetime(Datetime::from_days_since_epoch(day)));
+    Node::sequence(vec![("date", date), ("PX_LAST", float(px))])
+}
+
+fn security(ticker: &str, name: &str, data: Node) -> Node {
+    Node::sequence(vec![("security", string(ticker)), (name, data)])
+}
+
+#[test]
+fn replay_recording() -> Result<(), Error> {
+    let error = Node::sequence(vec![
+        ("category", string("BAD_SEC")),
+        ("message", string("Unknown security")),
+    ]);
+
+    // field chunks of the same security are merged by date
+    let mut recording = Recording::new();
+    for points in vec![vec![point(2, 1.), point(4, 2.)], vec![point(3, 3.)]] {
+        let security = security("IBM", "fieldData", Node::Array(points));
+        recording.push(
+            "HistoricalDataResponse",
+            Node::sequence(vec![("securityData", security)]),
+        );
+    }
+    let path = std::env::temp_dir().join(format!("blpapi-replay-{}.test", std::process::id()));
+    recording.save(&path)?;
+    let loaded = Recording::load(&path)?;
+    std::fs::remove_file(&path)?;
+    assert_eq!(loaded.messages().len(), 2);
+
+    let hist_data = loaded.hist_data::<Price>()?;
+    assert_eq!(hist_data.len(), 1);
+    let values = hist_data["IBM"]
+        .values
+        .iter()
+        .map(|p| p.px_last)
+        .collect::<Vec<_>>();
+    assert_eq!(values, vec![Some(1.), Some(3.), Some(2.)]);
+
+    let invalid = security("XXX", "securityError", error.clone());
+    recording.push(
+        "HistoricalDataResponse",
+        Node::sequence(vec![("securityData", invalid)]),
+    );
+    assert!(recording.hist_data::<Price>().is_err());
+
+    // securities in error fail the request
+    let ref_data = |securities: Vec<Node>| {
+        let mut recording = Recording::new();
+        let response = Node::sequence(vec![("securityData", Node::Array(securities))]);
+        recording.push("ReferenceDataResponse", response);
+        recording.ref_data::<Price>()
+    };
+    let ibm = || {
+        let fields = Node::sequence(vec![("PX_LAST", float(1.5)), ("CRNCY", string("USD"))]);
+        security("IBM", "fieldData", fields)
+    };
+    match ref_data(vec![ibm(), security("XXX", "securityError", error)]) {
+        Err(Error::Security {
+            security, category, ..
+        }) => assert_eq!((&*security, &*category), ("XXX", "BAD_SEC")),
+        _ => panic!("expecting a security error"),
+    }
+
+    let ref_data = ref_data(vec![ibm()])?;
+    assert_eq!(ref_data["IBM"].px_last, Some(1.5));
+    assert_eq!(ref_data["IBM"].crncy.as_deref(), Some("USD"));
+    Ok(())
+}